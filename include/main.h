@@ -1,23 +1,258 @@
 #ifndef PE_MAIN_H
 #define PE_MAIN_H
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <new>
 #include <string>
+#include <vector>
+
+#ifdef PE_RUNNER
+
+/*
+ * Compiled into the runner (peRegistry.h): register solution() under this
+ * file's number rather than defining main()
+ */
+#include "peRegistry.h"
+
+#define solution PE_REGISTRY_CONCAT( solution, PE_SOLUTION )
+std::string solution();
+static SolutionRegistrar peSolutionRegistrar( PE_REGISTRY_STRING( PE_SOLUTION ), &solution );
+
+#else
+
+#include "peInstrument.h"
+#include "peMemory.h"
+#include "pePerfCounters.h"
 
 std::string solution();
 
-int main() {
-    auto start_time = std::chrono::steady_clock::now();
+/*
+ * Global allocation functions that feed MemoryStats; they only count once
+ * --memory has enabled it. Defined here because each solution binary has
+ * exactly one translation unit including main.h (the runner does not)
+ */
+inline void* peAllocate( std::size_t size ) {
+    void* p = std::malloc( size ? size : 1 );
+    if ( !p ) throw std::bad_alloc();
+    MemoryStats::recordAllocation( p );
+    return p;
+}
 
-    std::string answer = solution();
-    std::cout << "Answer: " << answer << std::endl;
+inline void* peAllocate( std::size_t size, std::align_val_t alignment ) {
+    std::size_t align = (std::size_t) alignment;
+    void* p = std::aligned_alloc( align, ( ( size ? size : 1 ) + align - 1 ) / align * align );
+    if ( !p ) throw std::bad_alloc();
+    MemoryStats::recordAllocation( p );
+    return p;
+}
 
-    auto end_time = std::chrono::steady_clock::now();
-    auto run_time = end_time - start_time;
-    std::cout << "Time: " << std::chrono::duration<double, std::milli> (run_time).count() << " ms" << std::endl;
+inline void peFree( void* p ) {
+    MemoryStats::recordFree( p );
+    std::free( p );
+}
 
-    return 0;
+void* operator new( std::size_t size ) { return peAllocate( size ); }
+void* operator new[]( std::size_t size ) { return peAllocate( size ); }
+void* operator new( std::size_t size, std::align_val_t alignment ) { return peAllocate( size, alignment ); }
+void* operator new[]( std::size_t size, std::align_val_t alignment ) { return peAllocate( size, alignment ); }
+void* operator new( std::size_t size, const std::nothrow_t& ) noexcept {
+    try { return peAllocate( size ); } catch ( const std::bad_alloc& ) { return nullptr; }
 }
+void* operator new[]( std::size_t size, const std::nothrow_t& ) noexcept {
+    try { return peAllocate( size ); } catch ( const std::bad_alloc& ) { return nullptr; }
+}
+void operator delete( void* p ) noexcept { peFree( p ); }
+void operator delete[]( void* p ) noexcept { peFree( p ); }
+void operator delete( void* p, std::size_t ) noexcept { peFree( p ); }
+void operator delete[]( void* p, std::size_t ) noexcept { peFree( p ); }
+void operator delete( void* p, std::align_val_t ) noexcept { peFree( p ); }
+void operator delete[]( void* p, std::align_val_t ) noexcept { peFree( p ); }
+void operator delete( void* p, std::size_t, std::align_val_t ) noexcept { peFree( p ); }
+void operator delete[]( void* p, std::size_t, std::align_val_t ) noexcept { peFree( p ); }
+void operator delete( void* p, const std::nothrow_t& ) noexcept { peFree( p ); }
+void operator delete[]( void* p, const std::nothrow_t& ) noexcept { peFree( p ); }
+
+/*
+ * Command line options shared by every solution binary:
+ *   --bench N      time N runs of solution() and report min/median/p90/max
+ *   --warmup W     untimed runs before the timed ones (default 1 with --bench)
+ *   --expect X     compare the answer with X; exit status 1 on a mismatch
+ *   --json         print the result as one JSON object instead of text
+ *   --perf         hardware counters (pePerfCounters.h) per timed run, and
+ *                  per phase when built with PE_INSTRUMENT
+ *   --memory       heap allocations and peak live heap per timed run, and
+ *                  the process's peak RSS (peMemory.h); per phase too when
+ *                  built with PE_INSTRUMENT
+ * With no options a single run is timed, as before.
+ * Built with PE_INSTRUMENT, the phase breakdown (peInstrument.h) of the
+ * timed runs follows the result, on stderr in JSON mode.
+ */
+struct BenchmarkOptions {
+    int runs = 1;
+    int warmup = 0;
+    bool bench = false;
+    bool json = false;
+    bool perf = false;
+    bool memory = false;
+    bool checkAnswer = false;
+    std::string expected;
+    std::string name;
+
+    bool parse( int argc, char** argv ) {
+        const char* slash = std::strrchr( argv[0], '/' );
+        name = slash ? slash + 1 : argv[0];
+        bool warmupGiven = false;
+        for ( int i = 1; i < argc; i++ ) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if ( arg == "--bench" && hasValue ) {
+                bench = true;
+                runs = std::atoi( argv[++i] );
+                if ( runs < 1 ) return false;
+            } else if ( arg == "--warmup" && hasValue ) {
+                warmup = std::atoi( argv[++i] );
+                warmupGiven = true;
+                if ( warmup < 0 ) return false;
+            } else if ( arg == "--expect" && hasValue ) {
+                checkAnswer = true;
+                expected = argv[++i];
+            } else if ( arg == "--json" ) {
+                json = true;
+            } else if ( arg == "--perf" ) {
+                perf = true;
+            } else if ( arg == "--memory" ) {
+                memory = true;
+            } else {
+                return false;
+            }
+        }
+        if ( bench && !warmupGiven ) warmup = 1;
+        return true;
+    }
+};
+
+/*
+ * Nearest-rank percentile of sorted times; the median averages the
+ * middle pair
+ */
+inline double percentile( const std::vector<double>& sorted, double fraction ) {
+    if ( fraction == 0.5 && sorted.size() % 2 == 0 ) {
+        return ( sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2] ) / 2;
+    }
+    std::size_t rank = (std::size_t) std::ceil( fraction * sorted.size() );
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+inline std::string jsonEscape( const std::string& s ) {
+    std::string out;
+    for ( char c : s ) {
+        if ( c == '"' || c == '\\' ) out.push_back( '\\' );
+        if ( c == '\n' ) { out += "\\n"; continue; }
+        out.push_back( c );
+    }
+    return out;
+}
+
+int main( int argc, char** argv ) {
+    BenchmarkOptions options;
+    if ( !options.parse( argc, argv ) ) {
+        std::cerr << "Usage: " << argv[0] << " [--bench N] [--warmup W] [--expect ANSWER] [--json] [--perf] [--memory]" << std::endl;
+        return 2;
+    }
+    if ( options.perf && !PerfCounters::enable() ) {
+        std::cerr << "No performance counters available (perf_event_paranoid or a VM?)" << std::endl;
+    }
+
+    std::string answer;
+    for ( int i = 0; i < options.warmup; i++ ) {
+        PE_PHASE( "solution" );
+        answer = solution();
+    }
+    PE_RESET();
+
+    // only solution() is timed; printing happens after the last run
+    MemoryStats::enable( options.memory );
+    std::vector<double> times;
+    PerfSample perfTotal;
+    for ( int i = 0; i < options.runs; i++ ) {
+        PerfSample perfStart = PerfCounters::read();
+        auto start_time = std::chrono::steady_clock::now();
+        {
+            PE_PHASE( "solution" );
+            answer = solution();
+        }
+        auto end_time = std::chrono::steady_clock::now();
+        perfTotal += PerfCounters::read() - perfStart;
+        times.push_back( std::chrono::duration<double, std::milli> ( end_time - start_time ).count() );
+    }
+    // per run averages
+    for ( int e = 0; e < PerfSample::EVENTS; e++ ) perfTotal.values[e] /= options.runs;
+    const std::uint64_t allocations = MemoryStats::allocationCount() / options.runs;
+    const std::uint64_t allocatedBytes = MemoryStats::allocatedBytes() / options.runs;
+    const std::int64_t peakLive = MemoryStats::peakLiveBytes();
+    const std::uint64_t peakRss = MemoryStats::peakRss();
+    const bool perf = PerfCounters::isEnabled();
+    std::vector<double> sorted( times );
+    std::sort( sorted.begin(), sorted.end() );
+    bool correct = !options.checkAnswer || answer == options.expected;
+
+    if ( options.json ) {
+        std::cout << "{\"solution\": \"" << jsonEscape( options.name ) << "\""
+                  << ", \"answer\": \"" << jsonEscape( answer ) << "\"";
+        if ( options.checkAnswer ) {
+            std::cout << ", \"expected\": \"" << jsonEscape( options.expected ) << "\""
+                      << ", \"correct\": " << ( correct ? "true" : "false" );
+        }
+        std::cout << ", \"warmup\": " << options.warmup << ", \"runs\": " << options.runs
+                  << ", \"min_ms\": " << sorted.front() << ", \"median_ms\": " << percentile( sorted, 0.5 )
+                  << ", \"p90_ms\": " << percentile( sorted, 0.9 ) << ", \"max_ms\": " << sorted.back()
+                  << ", \"times_ms\": [";
+        for ( std::size_t i = 0; i < times.size(); i++ ) std::cout << ( i ? ", " : "" ) << times[i];
+        std::cout << "]";
+        if ( perf ) {
+            std::cout << ", \"perf\": {";
+            for ( int e = 0; e < PerfSample::EVENTS; e++ ) {
+                std::cout << ( e ? ", " : "" ) << "\"" << PerfSample::name( e ) << "\": ";
+                if ( PerfCounters::available( e ) ) std::cout << perfTotal.values[e];
+                else std::cout << "null";
+            }
+            std::cout << "}";
+        }
+        if ( options.memory ) {
+            std::cout << ", \"memory\": {\"allocations\": " << allocations << ", \"bytes_allocated\": " << allocatedBytes
+                      << ", \"peak_live_bytes\": " << peakLive << ", \"peak_rss_bytes\": " << peakRss << "}";
+        }
+        std::cout << "}" << std::endl;
+    } else {
+        std::cout << "Answer: " << answer << std::endl;
+        if ( !options.bench ) {
+            std::cout << "Time: " << times[0] << " ms" << std::endl;
+        } else {
+            std::cout << "Runs: " << options.runs << " (after " << options.warmup << " warm-up)"
+                      << "  min: " << sorted.front() << " ms  median: " << percentile( sorted, 0.5 )
+                      << " ms  p90: " << percentile( sorted, 0.9 ) << " ms  max: " << sorted.back() << " ms" << std::endl;
+        }
+        if ( !correct ) std::cout << "Wrong answer, expected: " << options.expected << std::endl;
+        if ( perf ) {
+            std::cout << "Counters (per run):" << std::endl;
+            PerfCounters::report( std::cout, perfTotal, 0, "  " );
+        }
+        if ( options.memory ) {
+            std::cout << "Memory (per run): " << allocations << " allocations, " << allocatedBytes / 1e6
+                      << " MB allocated, peak live " << peakLive / 1e6 << " MB; peak RSS " << peakRss / 1e6
+                      << " MB" << std::endl;
+        }
+    }
+    PE_REPORT( options.json ? std::cerr : std::cout );
+
+    return correct ? 0 : 1;
+}
+
+#endif // PE_RUNNER
 
 #endif
@@ -3,9 +3,14 @@
 
 #include <stdexcept>
 #include <climits>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 template<typename T, typename V = int>
-T ModularExp( T base, T exp, T mod ) {
+constexpr T ModularExp( T base, T exp, T mod ) {
     T result = 1;
     base %= mod;
     while ( exp > V(0) ) {
@@ -16,8 +21,112 @@ T ModularExp( T base, T exp, T mod ) {
     return result;
 }
 
+/*
+ * Left-to-right sliding window exponentiation.
+ * Precomputes the odd powers base^1, base^3, ..., base^(2^w - 1), then
+ * consumes the exponent a window of up to w bits at a time: one multiply
+ * per window instead of one per set bit, for ~b/(w+1) + 2^(w-1) multiplies
+ * on top of the b squarings. windowBits = 0 picks w from the exponent size:
+ * at most 4, since for b <= 64 a fifth bit costs more in odd powers than it
+ * saves in multiplies.
+ */
 template<typename T>
-T ModularInv( T a, T mod ) {
+T ModularExpWindow( T base, std::uint64_t exp, T mod, int windowBits = 0 ) {
+    if ( exp == 0 ) return T( 1 ) % mod;
+    const int bits = 64 - __builtin_clzll( exp );
+    int w = windowBits > 0 ? windowBits : bits <= 8 ? 1 : bits <= 24 ? 3 : 4;
+    if ( w > 6 ) w = 6;
+
+    T odd[32];
+    odd[0] = base % mod;
+    if ( w > 1 ) {
+        T square = ( odd[0] * odd[0] ) % mod;
+        for ( int i = 1; i < ( 1 << ( w - 1 ) ); i++ ) odd[i] = ( odd[i - 1] * square ) % mod;
+    }
+
+    T result = 1;
+    bool started = false;
+    int i = bits - 1;
+    while ( i >= 0 ) {
+        if ( ( ( exp >> i ) & 1 ) == 0 ) {
+            if ( started ) result = ( result * result ) % mod;
+            i--;
+            continue;
+        }
+        // longest window [l, i] of at most w bits that ends in a set bit
+        int l = i - w + 1 < 0 ? 0 : i - w + 1;
+        while ( ( ( exp >> l ) & 1 ) == 0 ) l++;
+        const int window = (int)( ( exp >> l ) & ( ( 1ULL << ( i - l + 1 ) ) - 1 ) );
+        if ( started ) {
+            for ( int j = l; j <= i; j++ ) result = ( result * result ) % mod;
+            result = ( result * odd[window >> 1] ) % mod;
+        } else {
+            result = odd[window >> 1];
+            started = true;
+        }
+        i = l - 1;
+    }
+    return result;
+}
+
+/*
+ * Exponentiation of one fixed base modulo a fixed modulus.
+ * The constructor tabulates base^(d * 2^(w*i)) for every w-bit digit d
+ * and digit position i, so each call is at most one multiply per nonzero
+ * digit of the exponent and no squarings: ~64/w multiplies for a 64-bit
+ * exponent, against ~96 for binary exponentiation.
+ * Worth it when the same base and modulus are raised to many exponents.
+ */
+template<typename T>
+class FixedBaseExp {
+public:
+    FixedBaseExp( T base, T mod, int maxExpBits = 64, int windowBits = 4 )
+        : mod( mod ), windowBits( checkedWindow( windowBits ) ),
+          digits( ( checkedExpBits( maxExpBits ) + this->windowBits - 1 ) / this->windowBits ),
+          table( (std::size_t) digits << this->windowBits ) {
+        T power = base % mod; // base^(2^(w*i))
+        for ( int i = 0; i < digits; i++ ) {
+            T* row = &table[i << windowBits];
+            row[0] = T( 1 ) % mod;
+            for ( int d = 1; d < ( 1 << windowBits ); d++ ) row[d] = ( row[d - 1] * power ) % mod;
+            power = ( row[( 1 << windowBits ) - 1] * power ) % mod;
+        }
+    }
+
+    T operator()( std::uint64_t exp ) const {
+        const std::uint64_t mask = ( 1ULL << windowBits ) - 1;
+        T result = T( 1 ) % mod;
+        bool started = false;
+        for ( int i = 0; exp != 0; i++, exp >>= windowBits ) {
+            if ( i >= digits ) throw std::out_of_range("Exponent larger than the table");
+            const std::uint64_t d = exp & mask;
+            if ( d == 0 ) continue;
+            const T& entry = table[( i << windowBits ) + d];
+            result = started ? ( result * entry ) % mod : entry;
+            started = true;
+        }
+        return result;
+    }
+
+private:
+    // checked before the initializers that shift by them
+    static int checkedWindow( int windowBits ) {
+        if ( windowBits < 1 || windowBits > 16 ) throw std::domain_error("Window must be 1 to 16 bits");
+        return windowBits;
+    }
+
+    static int checkedExpBits( int maxExpBits ) {
+        if ( maxExpBits < 1 || maxExpBits > 64 ) throw std::domain_error("Exponent must be 1 to 64 bits");
+        return maxExpBits;
+    }
+
+    T mod;
+    int windowBits, digits;
+    std::vector<T> table;
+};
+
+template<typename T>
+constexpr T ModularInv( T a, T mod ) {
     // returns zero if not invertible
     // based on extended euclidean algorithm
     // see https://en.wikipedia.org/wiki/Extended_Euclidean_algorithm
@@ -38,9 +147,349 @@ T ModularInv( T a, T mod ) {
     return t;
 }
 
+/*
+ * a * b % mod for a, b < mod, widening built-in types so the product
+ * cannot overflow
+ */
+template<typename T>
+constexpr T ModularMultiply( T a, T b, T mod ) {
+    if constexpr ( std::is_integral<T>::value && sizeof( T ) <= sizeof( std::uint32_t ) ) {
+        return (T)( (std::uint64_t) a * (std::uint64_t) b % (std::uint64_t) mod );
+    } else if constexpr ( std::is_integral<T>::value ) {
+        return (T)( (unsigned __int128) a * (unsigned __int128) b % (unsigned __int128) mod );
+    } else {
+        return a * b % mod;
+    }
+}
+
+/*
+ * Inverts count values under one modulus with Montgomery's trick:
+ * one ModularInv of the product of all values, then 3(count - 1)
+ * multiplications to unwind it. Values must be reduced (0 <= v < mod).
+ * Results match ModularInv element-wise: zero where not invertible.
+ * out holds the prefix products meanwhile, so it must not alias values.
+ */
+template<typename T>
+void batchModularInverse( const T* values, std::size_t count, T mod, T* out ) {
+    if ( count == 0 ) return;
+    // prefix products, skipping zeros so that one zero cannot spoil the rest
+    T running = 1;
+    for ( std::size_t i = 0; i < count; i++ ) {
+        if ( values[i] != 0 ) running = ModularMultiply( running, values[i], mod );
+        out[i] = running;
+    }
+    T inverse = ModularInv( running, mod );
+    if ( inverse == 0 ) {
+        // some value shares a factor with mod; no shortcut for the rest
+        for ( std::size_t i = 0; i < count; i++ ) out[i] = values[i] == 0 ? 0 : ModularInv( values[i], mod );
+        return;
+    }
+    for ( std::size_t i = count - 1; i > 0; i-- ) {
+        if ( values[i] == 0 ) {
+            out[i] = 0;
+            continue;
+        }
+        T value = values[i];
+        out[i] = ModularMultiply( inverse, out[i - 1], mod );
+        inverse = ModularMultiply( inverse, value, mod );
+    }
+    out[0] = values[0] == 0 ? 0 : inverse;
+}
+
+/*
+ * ModularInv over count (value, modulus) pairs. Four extended Euclid
+ * runs advance in lock step so their divisions overlap in the pipeline
+ * rather than waiting on one another. T must be signed, as for ModularInv.
+ */
+template<typename T>
+void multiModularInverse( const T* values, const T* mods, std::size_t count, T* out ) {
+    const std::size_t LANES = 4;
+    std::size_t i = 0;
+    for ( ; i + LANES <= count; i += LANES ) {
+        T t[LANES], nextT[LANES], r[LANES], nextR[LANES];
+        for ( std::size_t l = 0; l < LANES; l++ ) {
+            t[l] = 0; nextT[l] = 1;
+            r[l] = mods[i + l]; nextR[l] = values[i + l];
+        }
+        bool active = true;
+        while ( active ) {
+            active = false;
+            for ( std::size_t l = 0; l < LANES; l++ ) {
+                if ( nextR[l] == 0 ) continue;
+                T q = r[l] / nextR[l];
+                T temp = t[l] - q * nextT[l];
+                t[l] = nextT[l];
+                nextT[l] = temp;
+                temp = r[l] - q * nextR[l];
+                r[l] = nextR[l];
+                nextR[l] = temp;
+                active |= temp != 0;
+            }
+        }
+        for ( std::size_t l = 0; l < LANES; l++ ) {
+            if ( r[l] > 1 ) t[l] = 0;
+            else if ( t[l] < 0 ) t[l] += mods[i + l];
+            out[i + l] = t[l];
+        }
+    }
+    for ( ; i < count; i++ ) out[i] = ModularInv( values[i], mods[i] );
+}
+
+/*
+ * floor(sqrt(n)), corrected for floating point rounding
+ */
+inline std::uint64_t integerSqrt( std::uint64_t n ) {
+    std::uint64_t r = (std::uint64_t) std::sqrt( (double) n );
+    while ( r > 0 && r > n / r ) r--;
+    while ( r + 1 <= n / ( r + 1 ) ) r++;
+    return r;
+}
+
+/*
+ * Stein's binary gcd; shifts and subtractions only
+ */
+inline std::uint64_t binaryGcd( std::uint64_t a, std::uint64_t b ) {
+    if ( a == 0 ) return b;
+    if ( b == 0 ) return a;
+    int shift = __builtin_ctzll( a | b );
+    a >>= __builtin_ctzll( a );
+    do {
+        b >>= __builtin_ctzll( b );
+        if ( a > b ) std::swap( a, b );
+        b -= a;
+    } while ( b != 0 );
+    return a << shift;
+}
+
+/*
+ * Montgomery arithmetic modulo an odd n < 2^64, with R = 2^64.
+ * Values in Montgomery form (x * R mod n) multiply with two 128-bit
+ * products and no division; only construction and toMontgomery divide.
+ */
+class Montgomery64 {
+public:
+    explicit Montgomery64( std::uint64_t n ) : n( n ) {
+        if ( ( n & 1 ) == 0 ) throw std::domain_error("Montgomery modulus must be odd");
+        // Newton's iteration for n^-1 mod 2^64; n is its own inverse mod 8
+        nInv = n;
+        for ( int i = 0; i < 5; i++ ) nInv *= 2 - n * nInv;
+        rModN = ( 0 - n ) % n;
+        r2ModN = (std::uint64_t)( (unsigned __int128) rModN * rModN % n );
+    }
+
+    /*
+     * t * R^-1 mod n, for t < n * R
+     */
+    std::uint64_t reduce( unsigned __int128 t ) const {
+        std::uint64_t m = (std::uint64_t) t * nInv;
+        std::uint64_t high = (std::uint64_t)( t >> 64 );
+        std::uint64_t mnHigh = (std::uint64_t)( ( (unsigned __int128) m * n ) >> 64 );
+        return high < mnHigh ? high - mnHigh + n : high - mnHigh;
+    }
+
+    std::uint64_t toMontgomery( std::uint64_t x ) const { return reduce( (unsigned __int128)( x % n ) * r2ModN ); }
+    std::uint64_t fromMontgomery( std::uint64_t x ) const { return reduce( x ); }
+
+    std::uint64_t multiply( std::uint64_t a, std::uint64_t b ) const { return reduce( (unsigned __int128) a * b ); }
+    std::uint64_t add( std::uint64_t a, std::uint64_t b ) const { return a >= n - b ? a - ( n - b ) : a + b; }
+    std::uint64_t subtract( std::uint64_t a, std::uint64_t b ) const { return a >= b ? a - b : a + ( n - b ); }
+
+    // Montgomery forms of 1 and n - 1
+    std::uint64_t one() const { return rModN; }
+    std::uint64_t minusOne() const { return n - rModN; }
+
+    /*
+     * base^exp with base in Montgomery form; result in Montgomery form
+     */
+    std::uint64_t pow( std::uint64_t base, std::uint64_t exp ) const {
+        std::uint64_t result = rModN;
+        while ( exp > 0 ) {
+            if ( exp & 1 ) result = multiply( result, base );
+            exp >>= 1;
+            base = multiply( base, base );
+        }
+        return result;
+    }
+
+    std::uint64_t modulus() const { return n; }
+
+private:
+    std::uint64_t n, nInv, rModN, r2ModN;
+};
+
+/*
+ * Integer modulo a compile-time Mod < 2^32.
+ * Products fit in 64 bits and Mod is a constant, so the compiler reduces
+ * them with a multiply and shift rather than a hardware division.
+ * Addition and subtraction use a conditional subtract; no branches that
+ * stop the compiler vectorising loops over arrays of ModInt.
+ */
+template<std::uint32_t Mod>
+class ModInt {
+    static_assert( Mod >= 1, "Modulus must be positive" );
+public:
+    ModInt() : v( 0 ) {}
+
+    template<typename T>
+    ModInt( T x ) {
+        if ( x < 0 ) {
+            std::uint64_t r = ( 0 - (std::uint64_t) x ) % Mod;
+            v = r == 0 ? 0 : Mod - r;
+        } else {
+            v = (std::uint64_t) x % Mod;
+        }
+    }
+
+    static constexpr std::uint32_t modulus() { return Mod; }
+    std::uint32_t value() const { return v; }
+
+    ModInt& operator+=( ModInt other ) {
+        std::uint32_t sum = v + other.v;
+        v = sum >= Mod || sum < v ? sum - Mod : sum;
+        return *this;
+    }
+    ModInt& operator-=( ModInt other ) {
+        v = v >= other.v ? v - other.v : v + ( Mod - other.v );
+        return *this;
+    }
+    ModInt& operator*=( ModInt other ) {
+        v = (std::uint32_t)( (std::uint64_t) v * other.v % Mod );
+        return *this;
+    }
+    ModInt& operator/=( ModInt other ) { return *this *= other.inv(); }
+
+    friend ModInt operator+( ModInt a, ModInt b ) { return a += b; }
+    friend ModInt operator-( ModInt a, ModInt b ) { return a -= b; }
+    friend ModInt operator*( ModInt a, ModInt b ) { return a *= b; }
+    friend ModInt operator/( ModInt a, ModInt b ) { return a /= b; }
+    ModInt operator-() const { return ModInt() - *this; }
+    bool operator==( ModInt other ) const { return v == other.v; }
+    bool operator!=( ModInt other ) const { return v != other.v; }
+
+    ModInt pow( std::uint64_t exp ) const {
+        ModInt result( 1 ), base( *this );
+        while ( exp > 0 ) {
+            if ( exp & 1 ) result *= base;
+            exp >>= 1;
+            base *= base;
+        }
+        return result;
+    }
+
+    /*
+     * Throws if not invertible (Mod need not be prime)
+     */
+    ModInt inv() const {
+        std::int64_t inverse = ModularInv<std::int64_t>( v, Mod );
+        if ( inverse == 0 && Mod != 1 ) throw std::domain_error("Not invertible");
+        return ModInt( inverse );
+    }
+
+private:
+    std::uint32_t v;
+};
+
+/*
+ * Integer modulo a runtime modulus m < 2^32, shared by every DynModInt
+ * with the same Tag; set it with setModulus() before use.
+ * Products are reduced by Barrett reduction: with k = floor((2^64 - 1) / m),
+ * q = (x * k) >> 64 is floor(x / m) or one less, so one conditional
+ * subtraction finishes the job without a hardware division.
+ */
+template<typename Tag = void>
+class DynModInt {
+public:
+    DynModInt() : v( 0 ) {}
+
+    template<typename T>
+    DynModInt( T x ) {
+        if ( x < 0 ) {
+            std::uint64_t r = reduce( 0 - (std::uint64_t) x );
+            v = r == 0 ? 0 : mod - r;
+        } else {
+            v = reduce( (std::uint64_t) x );
+        }
+    }
+
+    static void setModulus( std::uint32_t m ) {
+        if ( m == 0 ) throw std::domain_error("Modulus must be positive");
+        mod = m;
+        barrett = ~0ULL / m;
+    }
+    static std::uint32_t modulus() { return mod; }
+
+    /*
+     * x mod m for any 64-bit x
+     */
+    static std::uint32_t reduce( std::uint64_t x ) {
+        std::uint64_t q = (std::uint64_t)( ( (unsigned __int128) x * barrett ) >> 64 );
+        std::uint64_t r = x - q * mod;
+        return (std::uint32_t)( r >= mod ? r - mod : r );
+    }
+
+    std::uint32_t value() const { return v; }
+
+    DynModInt& operator+=( DynModInt other ) {
+        std::uint64_t sum = (std::uint64_t) v + other.v;
+        v = (std::uint32_t)( sum >= mod ? sum - mod : sum );
+        return *this;
+    }
+    DynModInt& operator-=( DynModInt other ) {
+        v = v >= other.v ? v - other.v : v + ( mod - other.v );
+        return *this;
+    }
+    DynModInt& operator*=( DynModInt other ) {
+        v = reduce( (std::uint64_t) v * other.v );
+        return *this;
+    }
+    DynModInt& operator/=( DynModInt other ) { return *this *= other.inv(); }
+
+    friend DynModInt operator+( DynModInt a, DynModInt b ) { return a += b; }
+    friend DynModInt operator-( DynModInt a, DynModInt b ) { return a -= b; }
+    friend DynModInt operator*( DynModInt a, DynModInt b ) { return a *= b; }
+    friend DynModInt operator/( DynModInt a, DynModInt b ) { return a /= b; }
+    DynModInt operator-() const { return DynModInt() - *this; }
+    bool operator==( DynModInt other ) const { return v == other.v; }
+    bool operator!=( DynModInt other ) const { return v != other.v; }
+
+    DynModInt pow( std::uint64_t exp ) const {
+        DynModInt result( 1 ), base( *this );
+        while ( exp > 0 ) {
+            if ( exp & 1 ) result *= base;
+            exp >>= 1;
+            base *= base;
+        }
+        return result;
+    }
+
+    /*
+     * Throws if not invertible
+     */
+    DynModInt inv() const {
+        std::int64_t inverse = ModularInv<std::int64_t>( v, mod );
+        if ( inverse == 0 && mod != 1 ) throw std::domain_error("Not invertible");
+        return DynModInt( inverse );
+    }
+
+private:
+    std::uint32_t v;
+    inline static std::uint32_t mod = 1;
+    inline static std::uint64_t barrett = ~0ULL;
+};
+
+/*
+ * Quotient and remainder for types with only shifts and comparisons.
+ * Built-in integers use the hardware division; wide integers have an
+ * overload in peWideInt.h; anything else falls back to the bit-serial loop.
+ */
 template<typename T>
 void integerDivision( const T& numerator, const T& denominator, T* quotient, T* remainder ) {
     if ( denominator == 0 ) throw std::domain_error("Division by zero");
+    if constexpr ( std::is_integral<T>::value || std::is_same<T, unsigned __int128>::value ) {
+        *quotient = numerator / denominator;
+        *remainder = numerator % denominator;
+        return;
+    }
     T num = numerator;
     T den = denominator;
     T& quot = *quotient;
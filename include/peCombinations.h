@@ -1,11 +1,16 @@
 #ifndef PE_COMBINATIONS_H
 #define PE_COMBINATIONS_H
+
+#include <cstdint>
+#include <stdexcept>
+#include "pePrimes.h"
+
 /*
  * Generates the next combination of elements from "max Choose index"
  * index is so named because alterations start at (combination + index)
  * the rest of the array past that element is untouched
  */
-bool nextSeqNumericCombination( int* combination, int index, int max ) {
+inline bool nextSeqNumericCombination( int* combination, int index, int max ) {
     int i = index - 1;
     combination[i]++;
     while ( (i > 0) && (combination[i] >= (max + 1 - index) + 1 + i) ) {
@@ -20,4 +25,57 @@ bool nextSeqNumericCombination( int* combination, int index, int max ) {
     }
     return true;
 }
+
+/*
+ * Number of entries in rows 0 to rows - 1 of Pascal's triangle that the
+ * prime p does not divide, in O(log_p rows).
+ *
+ * By Lucas' theorem p does not divide n C k iff every base p digit of k is
+ * at most the matching digit of n, so row n has prod( n_i + 1 ) such
+ * entries, and the first p^i rows have T(i) = ( p(p+1)/2 )^i in all (the
+ * triangle mod p is self-similar). Writing rows in base p as d_m..d_0,
+ * a row below it first differs at some digit i, where it has one of
+ * 0..d_i - 1: those rows contribute
+ *     prod_{j > i}( d_j + 1 ) * d_i(d_i + 1)/2 * T(i)
+ * R must hold the result: rows(rows+1)/2 in the worst case, so
+ * unsigned __int128 (or UInt128) for rows up to 10^18 and small p.
+ * Lucas' theorem needs p prime, so any other p is rejected.
+ */
+template<typename R = std::uint64_t>
+R pascalNonMultiples( std::uint64_t rows, std::uint64_t p ) {
+    if ( !isMrPrime64( p ) ) throw std::invalid_argument( "pascalNonMultiples: p must be prime" );
+    std::uint64_t digits[64];
+    int length = 0;
+    for ( std::uint64_t n = rows; n; n /= p ) digits[length++] = n % p;
+
+    // T(i) for each digit position, lowest first
+    R blocks[64];
+    const R triangle = p % 2 ? (R) ( ( p + 1 ) / 2 ) * (R) p : (R) ( p / 2 ) * (R) ( p + 1 );
+    for ( int i = 0; i < length; i++ ) blocks[i] = i ? blocks[i - 1] * triangle : (R) 1;
+
+    R count = 0, prefix = 1;
+    for ( int i = length - 1; i >= 0; i-- ) {
+        const std::uint64_t d = digits[i];
+        const R lowerRows = d % 2 ? (R) ( ( d + 1 ) / 2 ) * (R) d : (R) ( d / 2 ) * (R) ( d + 1 );
+        count += prefix * lowerRows * blocks[i];
+        prefix *= (R) ( d + 1 );
+    }
+    return count;
+}
+
+/*
+ * pascalNonMultiples by applying Lucas' theorem to each row in turn;
+ * O(rows log_p rows), for validating the closed form
+ */
+template<typename R = std::uint64_t>
+R pascalNonMultiplesByRow( std::uint64_t rows, std::uint64_t p ) {
+    if ( !isMrPrime64( p ) ) throw std::invalid_argument( "pascalNonMultiplesByRow: p must be prime" );
+    R count = 0;
+    for ( std::uint64_t n = 0; n < rows; n++ ) {
+        R row = 1;
+        for ( std::uint64_t m = n; m; m /= p ) row *= (R) ( m % p + 1 );
+        count += row;
+    }
+    return count;
+}
 #endif
@@ -0,0 +1,268 @@
+#ifndef PE_INSTRUMENT_H
+#define PE_INSTRUMENT_H
+
+/*
+ * Scoped phase timers and named counters for solution hot paths.
+ * Compiled in only with -DPE_INSTRUMENT (make INSTRUMENT=1); otherwise
+ * the macros expand to nothing and their arguments are not evaluated.
+ *
+ *   PE_PHASE( "sieve" );            // times the rest of the enclosing scope
+ *   PE_COUNT( "candidates", n );    // adds n to a named counter
+ *   PE_ELEMENTS( n );               // n elements processed by the current phase
+ *   PE_RESET();                     // forget what was recorded so far
+ *
+ * A phase opened while another is running on the same thread nests under
+ * it. Totals are aggregated over every entry; main.h prints the tree and
+ * the counters when the program finishes. When main.h is run with --perf
+ * each phase also collects hardware counters (pePerfCounters.h), reported
+ * per element when the phase declared its elements; a phase's elements
+ * include those of its sub-phases. With --memory, each phase also records
+ * the allocations made while it ran and its peak live heap above what was
+ * live on entry (peMemory.h).
+ */
+
+#ifdef PE_INSTRUMENT
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "peMemory.h"
+#include "pePerfCounters.h"
+
+class Instrumentation {
+public:
+    struct Phase {
+        std::string name;
+        int parent;
+        std::uint64_t calls = 0;
+        std::uint64_t nanoseconds = 0;
+        std::uint64_t elements = 0;
+        PerfSample perf;
+        std::uint64_t allocations = 0;
+        std::uint64_t allocatedBytes = 0;
+        std::int64_t peakBytes = 0;
+        std::vector<int> children;
+    };
+
+    /*
+     * Makes the named child of the current phase current; returns its index
+     */
+    static int enter( const char* name ) {
+        std::lock_guard<std::mutex> lock( mutex() );
+        std::vector<Phase>& all = phases();
+        int& current = currentPhase();
+        for ( int child : all[current].children ) {
+            if ( all[child].name == name ) return current = child;
+        }
+        all.push_back( Phase{ name, current } );
+        int index = (int) all.size() - 1;
+        all[current].children.push_back( index );
+        return current = index;
+    }
+
+    static void leave( int phase, std::uint64_t nanoseconds, const PerfSample& perf ) {
+        std::lock_guard<std::mutex> lock( mutex() );
+        Phase& p = phases()[phase];
+        p.calls++;
+        p.nanoseconds += nanoseconds;
+        p.perf += perf;
+        currentPhase() = p.parent;
+    }
+
+    /*
+     * Heap use of one entry of a phase; the peak is the largest over entries
+     */
+    static void addMemory( int phase, std::uint64_t allocations, std::uint64_t bytes, std::int64_t peak ) {
+        std::lock_guard<std::mutex> lock( mutex() );
+        Phase& p = phases()[phase];
+        p.allocations += allocations;
+        p.allocatedBytes += bytes;
+        p.peakBytes = std::max( p.peakBytes, peak );
+    }
+
+    static void addElements( std::uint64_t n ) {
+        std::lock_guard<std::mutex> lock( mutex() );
+        std::vector<Phase>& all = phases();
+        for ( int phase = currentPhase(); phase > 0; phase = all[phase].parent ) all[phase].elements += n;
+    }
+
+    static std::atomic<std::uint64_t>& counter( const char* name ) {
+        std::lock_guard<std::mutex> lock( mutex() );
+        for ( auto& c : counters() ) {
+            if ( c.first == name ) return c.second;
+        }
+        counters().emplace_back( std::piecewise_construct, std::forward_as_tuple( name ), std::forward_as_tuple( 0 ) );
+        return counters().back().second;
+    }
+
+    /*
+     * Zeroes every phase and counter, keeping the names; call it with no
+     * phase running
+     */
+    static void reset() {
+        std::lock_guard<std::mutex> lock( mutex() );
+        for ( Phase& p : phases() ) {
+            p.calls = p.nanoseconds = p.elements = p.allocations = p.allocatedBytes = 0;
+            p.perf = PerfSample();
+            p.peakBytes = 0;
+        }
+        for ( auto& c : counters() ) c.second = 0;
+    }
+
+    static void report( std::ostream& out ) {
+        std::lock_guard<std::mutex> lock( mutex() );
+        const std::vector<Phase>& all = phases();
+        if ( all[0].children.empty() && counters().empty() ) return;
+        out << "Phases (ms, % of parent, entries):" << std::endl;
+        for ( int child : all[0].children ) reportPhase( out, child, 0 );
+        if ( !counters().empty() ) out << "Counters:" << std::endl;
+        for ( const auto& c : counters() ) {
+            out << "  " << std::left << std::setw( 32 ) << c.first << std::right << c.second.load() << std::endl;
+        }
+        if ( PerfCounters::isEnabled() ) {
+            out << "Phase counters:" << std::endl;
+            for ( std::size_t i = 1; i < all.size(); i++ ) {
+                std::string indent = "  ";
+                for ( int p = all[i].parent; p > 0; p = all[p].parent ) indent += "  ";
+                out << indent << all[i].name;
+                if ( all[i].elements ) out << " (" << all[i].elements << " elements)";
+                out << std::endl;
+                PerfCounters::report( out, all[i].perf, (double) all[i].elements, indent + "  ", false );
+            }
+        }
+        if ( MemoryStats::isEnabled() ) {
+            const std::streamsize precision = out.precision();
+            out << "Phase memory (allocations, MB allocated, MB peak live):" << std::endl;
+            for ( std::size_t i = 1; i < all.size(); i++ ) {
+                std::string label;
+                for ( int p = all[i].parent; p > 0; p = all[p].parent ) label += "  ";
+                out << "  " << std::left << std::setw( 32 ) << label + all[i].name << std::right
+                    << std::setw( 12 ) << all[i].allocations << std::fixed << std::setprecision( 3 )
+                    << std::setw( 12 ) << all[i].allocatedBytes / 1e6 << std::setw( 12 ) << all[i].peakBytes / 1e6
+                    << std::defaultfloat << std::endl;
+            }
+            out.precision( precision );
+        }
+    }
+
+private:
+    static void reportPhase( std::ostream& out, int index, int depth ) {
+        const std::vector<Phase>& all = phases();
+        const Phase& p = all[index];
+        const double ms = p.nanoseconds / 1e6;
+        const double parentMs = p.parent > 0 ? all[p.parent].nanoseconds / 1e6 : ms;
+        printLine( out, std::string( 2 * depth, ' ' ) + p.name, ms, parentMs, p.calls );
+        double childMs = 0;
+        for ( int child : p.children ) {
+            reportPhase( out, child, depth + 1 );
+            childMs += all[child].nanoseconds / 1e6;
+        }
+        if ( !p.children.empty() ) {
+            printLine( out, std::string( 2 * depth + 2, ' ' ) + "(other)", ms - childMs, ms, 0 );
+        }
+    }
+
+    static void printLine( std::ostream& out, const std::string& label, double ms, double parentMs, std::uint64_t calls ) {
+        const std::streamsize precision = out.precision();
+        out << "  " << std::left << std::setw( 32 ) << label << std::right << std::fixed << std::setprecision( 3 )
+            << std::setw( 12 ) << ms << std::setprecision( 1 ) << std::setw( 8 )
+            << ( parentMs > 0 ? 100 * ms / parentMs : 100.0 ) << "%";
+        if ( calls ) out << std::setw( 10 ) << calls;
+        out << std::defaultfloat << std::endl;
+        out.precision( precision );
+    }
+
+    // index 0 is the root that top level phases hang from
+    static std::vector<Phase>& phases() {
+        static std::vector<Phase> all( 1, Phase{ "", -1 } );
+        return all;
+    }
+
+    static std::deque<std::pair<std::string, std::atomic<std::uint64_t>>>& counters() {
+        static std::deque<std::pair<std::string, std::atomic<std::uint64_t>>> all;
+        return all;
+    }
+
+    static int& currentPhase() {
+        thread_local int current = 0;
+        return current;
+    }
+
+    static std::mutex& mutex() {
+        static std::mutex m;
+        return m;
+    }
+};
+
+/*
+ * Times its own lifetime as the named phase
+ */
+class ScopedPhase {
+public:
+    explicit ScopedPhase( const char* name )
+        : phase( Instrumentation::enter( name ) ), memory( MemoryStats::isEnabled() ) {
+        if ( memory ) {
+            allocationsStart = MemoryStats::allocationCount();
+            bytesStart = MemoryStats::allocatedBytes();
+            liveStart = MemoryStats::liveBytes();
+            enclosingWindow = MemoryStats::beginWindow();
+        }
+        perfStart = PerfCounters::read();
+        start = std::chrono::steady_clock::now();
+    }
+
+    ~ScopedPhase() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        PerfSample perf = PerfCounters::read() - perfStart;
+        if ( memory ) {
+            std::int64_t peak = MemoryStats::endWindow( enclosingWindow ) - liveStart;
+            Instrumentation::addMemory( phase, MemoryStats::allocationCount() - allocationsStart,
+                                        MemoryStats::allocatedBytes() - bytesStart, peak );
+        }
+        Instrumentation::leave( phase, std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed ).count(), perf );
+    }
+
+    ScopedPhase( const ScopedPhase& ) = delete;
+    ScopedPhase& operator=( const ScopedPhase& ) = delete;
+
+private:
+    int phase;
+    bool memory;
+    std::uint64_t allocationsStart = 0;
+    std::uint64_t bytesStart = 0;
+    std::int64_t liveStart = 0;
+    std::int64_t enclosingWindow = 0;
+    PerfSample perfStart;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define PE_CONCAT_INNER( a, b ) a##b
+#define PE_CONCAT( a, b ) PE_CONCAT_INNER( a, b )
+#define PE_PHASE( name ) ScopedPhase PE_CONCAT( pePhase, __LINE__ )( name )
+#define PE_COUNT( name, n ) do { \
+        static std::atomic<std::uint64_t>& peCounter = Instrumentation::counter( name ); \
+        peCounter.fetch_add( ( n ), std::memory_order_relaxed ); \
+    } while ( 0 )
+#define PE_ELEMENTS( n ) Instrumentation::addElements( n )
+#define PE_RESET() Instrumentation::reset()
+#define PE_REPORT( out ) Instrumentation::report( out )
+
+#else
+
+#define PE_PHASE( name ) do {} while ( 0 )
+#define PE_COUNT( name, n ) do {} while ( 0 )
+#define PE_ELEMENTS( n ) do {} while ( 0 )
+#define PE_RESET() do {} while ( 0 )
+#define PE_REPORT( out ) do {} while ( 0 )
+
+#endif
+
+#endif
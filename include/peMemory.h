@@ -0,0 +1,108 @@
+#ifndef PE_MEMORY_H
+#define PE_MEMORY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <malloc.h>
+#endif
+
+/*
+ * Allocation accounting fed by the operator new / delete replacements in
+ * main.h, plus resident set size from /proc/self/status.
+ * Counting is off until enable(); the hooks then cost two atomic updates
+ * per allocation. Sizes are the allocator's usable size of each block, so
+ * frees can be matched without a header; frees of blocks allocated before
+ * enable() can make live bytes dip below zero, which is harmless.
+ *
+ * For per-phase peaks, beginWindow() starts tracking a new high water
+ * mark and endWindow() returns it while folding it back into the
+ * enclosing window, so nested windows (on one thread) compose.
+ */
+class MemoryStats {
+public:
+    static void enable( bool on = true ) { enabled.store( on, std::memory_order_relaxed ); }
+    static bool isEnabled() { return enabled.load( std::memory_order_relaxed ); }
+
+    static void recordAllocation( void* p ) {
+        if ( !p || !isEnabled() ) return;
+        const std::int64_t size = usableSize( p );
+        allocations.fetch_add( 1, std::memory_order_relaxed );
+        bytes.fetch_add( size, std::memory_order_relaxed );
+        const std::int64_t now = live.fetch_add( size, std::memory_order_relaxed ) + size;
+        raise( peak, now );
+        raise( window, now );
+    }
+
+    static void recordFree( void* p ) {
+        if ( !p || !isEnabled() ) return;
+        live.fetch_sub( usableSize( p ), std::memory_order_relaxed );
+    }
+
+    static std::uint64_t allocationCount() { return allocations.load( std::memory_order_relaxed ); }
+    static std::uint64_t allocatedBytes() { return bytes.load( std::memory_order_relaxed ); }
+    static std::int64_t liveBytes() { return live.load( std::memory_order_relaxed ); }
+    static std::int64_t peakLiveBytes() { return peak.load( std::memory_order_relaxed ); }
+
+    /*
+     * Starts a new high water mark at the current live bytes; returns the
+     * enclosing window's mark, to be handed back to endWindow()
+     */
+    static std::int64_t beginWindow() {
+        return window.exchange( liveBytes(), std::memory_order_relaxed );
+    }
+
+    /*
+     * High water mark of live bytes since the matching beginWindow()
+     */
+    static std::int64_t endWindow( std::int64_t enclosing ) {
+        const std::int64_t mark = window.load( std::memory_order_relaxed );
+        window.store( std::max( enclosing, mark ), std::memory_order_relaxed );
+        return mark;
+    }
+
+    /*
+     * Peak and current resident set size in bytes (VmHWM / VmRSS); 0 where
+     * /proc is unavailable
+     */
+    static std::uint64_t peakRss() { return statusBytes( "VmHWM:" ); }
+    static std::uint64_t currentRss() { return statusBytes( "VmRSS:" ); }
+
+private:
+    static std::int64_t usableSize( void* p ) {
+#ifdef __linux__
+        return (std::int64_t) malloc_usable_size( p );
+#else
+        return 0;
+#endif
+    }
+
+    static void raise( std::atomic<std::int64_t>& mark, std::int64_t value ) {
+        std::int64_t current = mark.load( std::memory_order_relaxed );
+        while ( value > current && !mark.compare_exchange_weak( current, value, std::memory_order_relaxed ) );
+    }
+
+    static std::uint64_t statusBytes( const char* field ) {
+        std::ifstream status( "/proc/self/status" );
+        std::string name;
+        std::uint64_t kilobytes;
+        while ( status >> name ) {
+            if ( name == field && status >> kilobytes ) return kilobytes * 1024;
+            status.ignore( 256, '\n' );
+        }
+        return 0;
+    }
+
+    inline static std::atomic<bool> enabled{ false };
+    inline static std::atomic<std::uint64_t> allocations{ 0 };
+    inline static std::atomic<std::uint64_t> bytes{ 0 };
+    inline static std::atomic<std::int64_t> live{ 0 };
+    inline static std::atomic<std::int64_t> peak{ 0 };
+    inline static std::atomic<std::int64_t> window{ 0 };
+};
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef PE_PARALLEL_H
+#define PE_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "pePerfCounters.h"
+
+/*
+ * Work-stealing thread pool for solution loops:
+ *   parallelFor( 0, n, [&]( std::int64_t i ) { ... } );
+ *   long long sum = parallelReduce( 0, n, 0LL, f, std::plus<long long>() );
+ *
+ * Each worker owns a deque of index ranges. It works through its current
+ * range in chunks of `grain` indices, and whenever its own deque is empty
+ * it first splits off the upper half of what is left for others to steal.
+ * Idle workers steal the oldest (largest) range from another deque. Ranges
+ * are only split while some worker could take them, so a loop with nobody
+ * stealing runs as a few large chunks. A worker that finds nothing to pop
+ * or steal sleeps until a range is queued or the loop finishes, so a long
+ * tail does not keep idle cores busy.
+ *
+ * The calling thread works on the loop too. A loop started from inside
+ * another (or while the pool is busy with another caller's loop) runs
+ * serially on the calling thread. The first exception thrown by the body
+ * stops further chunks and is rethrown to the caller once the loop has
+ * drained. Workers of a pool created before the performance counters
+ * were enabled attach to them (pePerfCounters.h) when they join a loop,
+ * so --perf includes their work either way.
+ */
+class ThreadPool {
+public:
+    /*
+     * threads includes the calling thread; 1 runs every loop serially
+     */
+    explicit ThreadPool( unsigned int threads = defaultThreads() ) {
+        threads = std::max( 1u, threads );
+        for ( unsigned int t = 0; t < threads; t++ ) queues.emplace_back( new Queue );
+        for ( unsigned int t = 1; t < threads; t++ ) workers.emplace_back( [this, t]() { workerLoop( t ); } );
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock( stateMutex );
+            stopping = true;
+        }
+        wake.notify_all();
+        for ( auto& worker : workers ) worker.join();
+    }
+
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+
+    unsigned int size() const { return (unsigned int) queues.size(); }
+
+    /*
+     * PE_THREADS from the environment if set, otherwise the number of cores
+     */
+    static unsigned int defaultThreads() {
+        const char* env = std::getenv( "PE_THREADS" );
+        if ( env && std::atoi( env ) > 0 ) return (unsigned int) std::atoi( env );
+        return std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    /*
+     * The pool used by parallelFor and parallelReduce unless given another
+     */
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    /*
+     * Calls body( lo, hi ) on disjoint subranges covering [begin, end), each
+     * at most grain long; grain <= 0 picks about 64 chunks per thread
+     */
+    template<typename Body>
+    void forRange( std::int64_t begin, std::int64_t end, Body body, std::int64_t grain = 0 ) {
+        if ( end <= begin ) return;
+        if ( grain <= 0 ) grain = std::max<std::int64_t>( 1, ( end - begin ) / ( 64 * size() ) );
+        bool& inside = insideLoop();
+        std::unique_lock<std::mutex> serial( runMutex, std::defer_lock );
+        if ( size() == 1 || inside || !serial.try_lock() ) {
+            for ( std::int64_t lo = begin; lo < end; lo += std::min( grain, end - lo ) ) {
+                body( lo, lo + std::min( grain, end - lo ) );
+            }
+            return;
+        }
+
+        Job job;
+        job.body = [&body]( std::int64_t lo, std::int64_t hi ) { body( lo, hi ); };
+        job.grain = grain;
+        job.remaining = end - begin;
+        push( 0, Range( begin, end ) );
+        {
+            std::lock_guard<std::mutex> lock( stateMutex );
+            current = &job;
+            generation++;
+        }
+        wake.notify_all();
+
+        inside = true;
+        run( 0, job );
+        inside = false;
+        {
+            // workers may still be looking at the job; wait until they let go
+            std::unique_lock<std::mutex> lock( stateMutex );
+            current = nullptr;
+            idle.wait( lock, [this]() { return active == 0; } );
+        }
+        if ( job.error ) std::rethrow_exception( job.error );
+    }
+
+private:
+    typedef std::pair<std::int64_t, std::int64_t> Range;
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+    };
+
+    struct Job {
+        std::function<void( std::int64_t, std::int64_t )> body;
+        std::int64_t grain;
+        std::atomic<std::int64_t> remaining;
+        std::atomic<bool> failed{ false };
+        std::mutex errorMutex;
+        std::exception_ptr error;
+    };
+
+    static bool& insideLoop() {
+        thread_local bool inside = false;
+        return inside;
+    }
+
+    void workerLoop( unsigned int self ) {
+        insideLoop() = true;
+        PerfCounters::threadStarted();
+        std::uint64_t seen = 0;
+        for ( ;; ) {
+            Job* job;
+            {
+                std::unique_lock<std::mutex> lock( stateMutex );
+                wake.wait( lock, [&]() { return stopping || ( current && generation != seen ); } );
+                if ( stopping ) return;
+                seen = generation;
+                job = current;
+                active++;
+            }
+            PerfCounters::attachThread();
+            run( self, *job );
+            {
+                std::lock_guard<std::mutex> lock( stateMutex );
+                active--;
+            }
+            idle.notify_all();
+        }
+    }
+
+    void run( unsigned int self, Job& job ) {
+        Range range;
+        while ( job.remaining.load( std::memory_order_acquire ) > 0 ) {
+            if ( pop( self, &range ) || steal( self, &range ) ) {
+                process( self, job, range );
+                continue;
+            }
+            // queued and remaining are published before sleepers is read
+            // (see push and process), so a wake-up cannot be missed
+            std::unique_lock<std::mutex> lock( workMutex );
+            sleepers++;
+            workReady.wait( lock, [&]() { return queued > 0 || job.remaining.load() <= 0; } );
+            sleepers--;
+        }
+    }
+
+    /*
+     * Wakes sleeping workers after queued or a job's remaining changed
+     */
+    void notifySleepers( bool all ) {
+        if ( sleepers.load() == 0 ) return;
+        { std::lock_guard<std::mutex> lock( workMutex ); }
+        if ( all ) workReady.notify_all();
+        else workReady.notify_one();
+    }
+
+    void push( unsigned int self, Range range ) {
+        {
+            std::lock_guard<std::mutex> lock( queues[self]->mutex );
+            queues[self]->ranges.push_back( range );
+            queued++;
+        }
+        notifySleepers( false );
+    }
+
+    void process( unsigned int self, Job& job, Range range ) {
+        std::int64_t lo = range.first, hi = range.second;
+        while ( lo < hi ) {
+            if ( hi - lo > 2 * job.grain ) {
+                Queue& own = *queues[self];
+                std::unique_lock<std::mutex> lock( own.mutex );
+                if ( own.ranges.empty() ) {
+                    std::int64_t mid = lo + ( hi - lo ) / 2;
+                    own.ranges.emplace_back( mid, hi );
+                    hi = mid;
+                    queued++;
+                    lock.unlock();
+                    notifySleepers( false );
+                }
+            }
+            std::int64_t next = std::min( hi, lo + job.grain );
+            if ( !job.failed.load( std::memory_order_relaxed ) ) {
+                try {
+                    job.body( lo, next );
+                } catch ( ... ) {
+                    std::lock_guard<std::mutex> lock( job.errorMutex );
+                    if ( !job.error ) job.error = std::current_exception();
+                    job.failed = true;
+                }
+            }
+            if ( job.remaining.fetch_sub( next - lo ) == next - lo ) notifySleepers( true );
+            lo = next;
+        }
+    }
+
+    bool pop( unsigned int self, Range* range ) {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock( own.mutex );
+        if ( own.ranges.empty() ) return false;
+        *range = own.ranges.back();
+        own.ranges.pop_back();
+        queued--;
+        return true;
+    }
+
+    bool steal( unsigned int self, Range* range ) {
+        for ( unsigned int k = 1; k < size(); k++ ) {
+            Queue& victim = *queues[( self + k ) % size()];
+            std::lock_guard<std::mutex> lock( victim.mutex );
+            if ( victim.ranges.empty() ) continue;
+            *range = victim.ranges.front();
+            victim.ranges.pop_front();
+            queued--;
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex runMutex;
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    // ranges waiting in any deque, and workers asleep waiting for one
+    std::atomic<std::int64_t> queued{ 0 };
+    std::atomic<int> sleepers{ 0 };
+    std::mutex workMutex;
+    std::condition_variable workReady;
+    Job* current = nullptr;
+    std::uint64_t generation = 0;
+    int active = 0;
+    bool stopping = false;
+};
+
+/*
+ * Calls f( i ) for every i in [begin, end)
+ */
+template<typename F>
+void parallelFor( std::int64_t begin, std::int64_t end, F f, std::int64_t grain = 0,
+                  ThreadPool& pool = ThreadPool::shared() ) {
+    pool.forRange( begin, end, [&f]( std::int64_t lo, std::int64_t hi ) {
+        for ( std::int64_t i = lo; i < hi; i++ ) f( i );
+    }, grain );
+}
+
+/*
+ * combine( ..., f( i ) ) over [begin, end), starting from identity.
+ * The range is cut into blocks whose boundaries depend only on the range
+ * (and blockSize, if given), each block is folded left to right, and the
+ * block results are combined in order; so the answer is the same for any
+ * thread count or schedule, even for floating point or a combine that is
+ * associative but not commutative.
+ */
+template<typename T, typename F, typename Combine>
+T parallelReduce( std::int64_t begin, std::int64_t end, T identity, F f, Combine combine,
+                  std::int64_t blockSize = 0, ThreadPool& pool = ThreadPool::shared() ) {
+    if ( end <= begin ) return identity;
+    const std::int64_t n = end - begin;
+    if ( blockSize <= 0 ) blockSize = std::max<std::int64_t>( 1, ( n + 1023 ) / 1024 );
+    const std::int64_t blocks = ( n + blockSize - 1 ) / blockSize;
+    std::vector<T> partial( blocks, identity );
+    pool.forRange( 0, blocks, [&]( std::int64_t lo, std::int64_t hi ) {
+        for ( std::int64_t b = lo; b < hi; b++ ) {
+            T value = identity;
+            const std::int64_t last = std::min( end, begin + ( b + 1 ) * blockSize );
+            for ( std::int64_t i = begin + b * blockSize; i < last; i++ ) value = combine( value, f( i ) );
+            partial[b] = value;
+        }
+    }, 1 );
+    T result = identity;
+    for ( const T& value : partial ) result = combine( result, value );
+    return result;
+}
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef PE_PERF_COUNTERS_H
+#define PE_PERF_COUNTERS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Hardware event counters via Linux perf_event_open; user space only, so
+ * they work at perf_event_paranoid <= 2. Events the kernel or CPU cannot
+ * provide (e.g. in a VM) are reported as unavailable rather than failing
+ * the run.
+ *
+ * enable() counts the calling thread and, through inheritance, threads
+ * created after it. Threads that already existed are not counted unless
+ * they call attachThread(), as the peParallel.h pool workers do, which
+ * gives them counters of their own for read() to add in. Such threads call
+ * threadStarted() first thing, so that attachThread() knows whether they
+ * already inherit the counters.
+ *
+ * The counters run freely once enabled; callers take a PerfSample before
+ * and after the code of interest and subtract.
+ */
+struct PerfSample {
+    enum Event { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, DTLB_MISSES, PAGE_FAULTS, EVENTS };
+
+    std::uint64_t values[EVENTS] = {};
+
+    PerfSample& operator+=( const PerfSample& o ) {
+        for ( int i = 0; i < EVENTS; i++ ) values[i] += o.values[i];
+        return *this;
+    }
+    friend PerfSample operator-( PerfSample a, const PerfSample& b ) {
+        for ( int i = 0; i < EVENTS; i++ ) a.values[i] -= b.values[i];
+        return a;
+    }
+
+    static const char* name( int event ) {
+        static const char* names[EVENTS] = { "cycles", "instructions", "L1d misses", "LLC misses",
+                                             "branch misses", "dTLB misses", "page faults" };
+        return names[event];
+    }
+};
+
+class PerfCounters {
+public:
+    /*
+     * Opens the counters; returns false if none of them could be opened
+     */
+    static bool enable() {
+        PerfCounters& p = instance();
+        if ( p.enabled ) return true;
+        bool any = false;
+        for ( int i = 0; i < PerfSample::EVENTS; i++ ) {
+            p.fds[i] = openEvent( i );
+            any |= p.fds[i] >= 0;
+        }
+        p.enabled = any;
+        return any;
+    }
+
+    static bool isEnabled() { return instance().enabled; }
+
+    static bool available( int event ) { return instance().fds[event] >= 0; }
+
+    /*
+     * Records whether a new thread inherits the counters; call it at the
+     * start of any thread that may later call attachThread()
+     */
+    static void threadStarted() {
+        threadCounters().inherited = instance().enabled;
+    }
+
+    /*
+     * Opens counters for the calling thread that every read() includes
+     * until the thread exits; does nothing if the counters are not enabled,
+     * the thread inherited them or it is already attached
+     */
+    static void attachThread() {
+        PerfCounters& p = instance();
+        if ( !p.enabled ) return;
+        ThreadCounters& counters = threadCounters();
+        if ( counters.inherited || counters.attached ) return;
+        for ( int i = 0; i < PerfSample::EVENTS; i++ ) counters.fds[i] = available( i ) ? openEvent( i ) : -1;
+        std::lock_guard<std::mutex> lock( p.threadsMutex );
+        p.threads.push_back( &counters );
+        counters.attached = true;
+    }
+
+    /*
+     * Current counts of the enabling thread and every attached thread,
+     * scaled up if the kernel had to multiplex the counters
+     */
+    static PerfSample read() {
+        PerfSample sample;
+        PerfCounters& p = instance();
+        if ( !p.enabled ) return sample;
+        addCounts( p.fds, &sample );
+        std::lock_guard<std::mutex> lock( p.threadsMutex );
+        for ( const ThreadCounters* t : p.threads ) addCounts( t->fds, &sample );
+        return sample;
+    }
+
+    /*
+     * One line per event; with elements > 0 also the count per element.
+     * Unavailable events print as n/a, or are skipped if !showUnavailable
+     */
+    static void report( std::ostream& out, const PerfSample& s, double elements, const std::string& indent,
+                        bool showUnavailable = true ) {
+        const std::streamsize precision = out.precision();
+        for ( int i = 0; i < PerfSample::EVENTS; i++ ) {
+            if ( !available( i ) && !showUnavailable ) continue;
+            out << indent << std::left << std::setw( 16 ) << PerfSample::name( i ) << std::right;
+            if ( !available( i ) ) {
+                out << std::setw( 16 ) << "n/a" << std::endl;
+                continue;
+            }
+            out << std::setw( 16 ) << s.values[i];
+            if ( i == PerfSample::INSTRUCTIONS && available( PerfSample::CYCLES ) && s.values[PerfSample::CYCLES] ) {
+                out << "  IPC " << std::fixed << std::setprecision( 2 )
+                    << (double) s.values[i] / s.values[PerfSample::CYCLES] << std::defaultfloat;
+            }
+            if ( elements > 0 ) {
+                out << "  " << std::setprecision( 4 ) << s.values[i] / elements << " per element" << std::defaultfloat;
+            }
+            out << std::endl;
+        }
+        out.precision( precision );
+    }
+
+private:
+    struct ThreadCounters {
+        int fds[PerfSample::EVENTS];
+        bool inherited = false;
+        bool attached = false;
+
+        ~ThreadCounters() {
+            if ( !attached ) return;
+            PerfCounters& p = instance();
+            {
+                std::lock_guard<std::mutex> lock( p.threadsMutex );
+                p.threads.erase( std::find( p.threads.begin(), p.threads.end(), this ) );
+            }
+            closeAll( fds );
+        }
+    };
+
+    PerfCounters() {
+        for ( int i = 0; i < PerfSample::EVENTS; i++ ) fds[i] = -1;
+    }
+
+    static ThreadCounters& threadCounters() {
+        thread_local ThreadCounters counters;
+        return counters;
+    }
+
+    // never destroyed, so threads exiting during static destruction can
+    // still detach; the kernel closes the counters at exit
+    static PerfCounters& instance() {
+        static PerfCounters& counters = *new PerfCounters;
+        return counters;
+    }
+
+    /*
+     * One counter for the calling thread; -1 if it cannot be opened
+     */
+    static int openEvent( int event ) {
+#ifdef __linux__
+        const std::uint64_t readMiss = ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 );
+        const std::uint32_t types[PerfSample::EVENTS] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+            PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_SOFTWARE };
+        const std::uint64_t configs[PerfSample::EVENTS] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_L1D | readMiss,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_DTLB | readMiss,
+            PERF_COUNT_SW_PAGE_FAULTS };
+        perf_event_attr attr;
+        std::memset( &attr, 0, sizeof( attr ) );
+        attr.size = sizeof( attr );
+        attr.type = types[event];
+        attr.config = configs[event];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return (int) syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+#else
+        return -1;
+#endif
+    }
+
+    static void addCounts( const int* fds, PerfSample* sample ) {
+#ifdef __linux__
+        for ( int i = 0; i < PerfSample::EVENTS; i++ ) {
+            std::uint64_t data[3];
+            if ( fds[i] < 0 || ::read( fds[i], data, sizeof( data ) ) != (ssize_t) sizeof( data ) ) continue;
+            sample->values[i] += data[2] == 0 ? 0 : (std::uint64_t)( (double) data[0] * data[1] / data[2] );
+        }
+#endif
+    }
+
+    static void closeAll( const int* fds ) {
+#ifdef __linux__
+        for ( int i = 0; i < PerfSample::EVENTS; i++ ) if ( fds[i] >= 0 ) close( fds[i] );
+#endif
+    }
+
+    bool enabled = false;
+    int fds[PerfSample::EVENTS];
+    std::mutex threadsMutex;
+    std::vector<const ThreadCounters*> threads;
+};
+
+#endif
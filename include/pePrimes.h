@@ -1,11 +1,58 @@
 #ifndef PE_PRIMES_H
 #define PE_PRIMES_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <map>
 #include <stdexcept>
 #include "peCalculation.h"
 
+/*
+ * Prime factorisation as (prime, exponent) pairs, stored inline.
+ * No integer below 2^64 has more than 15 distinct prime factors,
+ * so this never needs the heap.
+ */
+template<typename T>
+class PrimeFactorization {
+public:
+    static const int CAPACITY = 15;
+
+    PrimeFactorization() : count( 0 ) {}
+
+    /*
+     * Appends a prime, merging it with the last entry if equal;
+     * equal primes must therefore be added consecutively
+     */
+    void add( T prime, int exponent = 1 ) {
+        if ( count > 0 && factors[count - 1].first == prime ) {
+            factors[count - 1].second += exponent;
+        } else {
+            if ( count == CAPACITY ) throw std::length_error("Too many distinct prime factors");
+            factors[count++] = std::pair<T, int>( prime, exponent );
+        }
+    }
+
+    int size() const { return count; }
+    const std::pair<T, int>& operator[]( int i ) const { return factors[i]; }
+
+    std::pair<T, int>* begin() { return factors; }
+    std::pair<T, int>* end() { return factors + count; }
+    const std::pair<T, int>* begin() const { return factors; }
+    const std::pair<T, int>* end() const { return factors + count; }
+
+private:
+    std::pair<T, int> factors[CAPACITY];
+    int count;
+};
+
 /*
  * Calculates EulerTotient function using list
  * of prime factors (including multiplicity)
@@ -23,9 +70,23 @@ inline int EulerTotient( const std::vector<int>& primeFactors ) {
     return answer;
 }
 
+/*
+ * EulerTotient from a grouped factorisation
+ * phi(n) = product of p^(e-1) * (p-1)
+ */
+template<typename T>
+T EulerTotient( const PrimeFactorization<T>& factorization ) {
+    T answer = 1;
+    for ( const auto& factor : factorization ) {
+        answer *= factor.first - 1;
+        for ( int i = 1; i < factor.second; i++ ) answer *= factor.first;
+    }
+    return answer;
+}
+
 template<typename T>
-bool isPrime( T n ) {
-    if ( n == 1 ) return false;
+constexpr bool isPrime( T n ) {
+    if ( n < 2 ) return false;
     if ( n == 2 || n == 3 ) return true;
     int i = 2;
     while ( (T)i * (T)i <= n ) {
@@ -34,6 +95,24 @@ bool isPrime( T n ) {
     return true;
 }
 
+/*
+ * The first N primes, computed at compile time when used in a constant
+ * expression: static constexpr auto primes = smallPrimes<25>();
+ */
+template<std::size_t N>
+constexpr std::array<std::uint32_t, N> smallPrimes() {
+    std::array<std::uint32_t, N> primes{};
+    std::size_t count = 0;
+    for ( std::uint32_t n = 2; count < N; n++ ) {
+        bool prime = true;
+        for ( std::size_t i = 0; prime && i < count && primes[i] * primes[i] <= n; i++ ) {
+            prime = n % primes[i] != 0;
+        }
+        if ( prime ) primes[count++] = n;
+    }
+    return primes;
+}
+
 template<typename T>
 bool isPrime( T n, const std::vector<bool>& table ) {
     if ( n < 2 ) return false;
@@ -53,9 +132,10 @@ bool isPrime( T n, const std::vector<bool>& table ) {
 
 /*
  * Miller-Rabin primality test
+ * testCases is any container of int witnesses (vector, constexpr array)
  */
-template<typename T, typename V = int>
-bool isMrPrime( T n, const std::vector<int>& testCases ) {
+template<typename T, typename V = int, typename Witnesses = std::vector<int>>
+bool isMrPrime( T n, const Witnesses& testCases ) {
     if ( n <= (V)1 ) return false;
     if ( n == (V)2 ) return true;
     if ( n % (V)2 == 0 ) return false;
@@ -84,132 +164,1114 @@ bool isMrPrime( T n, const std::vector<int>& testCases ) {
     return true;
 }
 
+/*
+ * Deterministic Miller-Rabin for any 64-bit n.
+ * Montgomery multiplication with 128-bit products; no division or
+ * allocation in the exponentiation.
+ * Bases are Jim Sinclair's set, proven for all n < 2^64.
+ */
+inline bool isMrPrime64( std::uint64_t n ) {
+    static constexpr auto trialPrimes = smallPrimes<12>();
+    static constexpr std::uint64_t bases[] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+    if ( n < 2 ) return false;
+    for ( std::uint64_t p : trialPrimes ) {
+        if ( n % p == 0 ) return n == p;
+    }
+    if ( n < 37 * 37 ) return true;
+
+    //find s s.t. n - 1 == 2^s * d for odd d;
+    std::uint64_t d = n - 1;
+    int s = __builtin_ctzll( d );
+    d >>= s;
+
+    const Montgomery64 mont( n );
+    const std::uint64_t one = mont.one(), minusOne = mont.minusOne();
+    for ( std::uint64_t a : bases ) {
+        a %= n;
+        if ( a == 0 ) continue;
+        std::uint64_t x = mont.pow( mont.toMontgomery( a ), d );
+        if ( x == one || x == minusOne ) continue;
+        int i = 1;
+        for ( ; i < s; i++ ) {
+            x = mont.multiply( x, x );
+            if ( x == minusOne ) break;
+        }
+        if ( i == s ) return false;
+    }
+    return true;
+}
+
+/*
+ * One strong probable prime round to base a for LANES odd moduli at once.
+ * a^d is computed left to right with fixed 4-bit windows: a table of
+ * a^0..a^15 per lane, then four squarings and one table multiply per
+ * window, so every lane does identical work with no data-dependent
+ * branches (~1.25 multiplies per exponent bit against ~1.5 for binary).
+ * Exponents of 16 bits or less use 2-bit windows, where the larger
+ * table would cost more than it saves.
+ * The lanes' chains are independent and the loops over lanes are
+ * unrolled, so their Montgomery multiplies overlap instead of waiting on
+ * each other's latency. This is instruction-level parallelism on scalar
+ * registers, not SIMD: x86 vector units have no 64x64->128 bit multiply.
+ * pass[l] is set if mont[l].modulus() is a strong probable prime to base a.
+ */
+template<std::size_t LANES>
+void strongProbablePrimeLanes( const Montgomery64* mont, const std::uint64_t* d, const int* s,
+                               std::uint64_t a, bool* pass ) {
+    std::uint64_t x[LANES], one[LANES], minusOne[LANES], table[16][LANES];
+    std::uint64_t allBits = 0;
+#pragma GCC unroll 8
+    for ( std::size_t l = 0; l < LANES; l++ ) {
+        one[l] = mont[l].one();
+        minusOne[l] = mont[l].minusOne();
+        table[0][l] = one[l];
+        table[1][l] = mont[l].toMontgomery( a );
+        allBits |= d[l];
+    }
+    const int bits = 64 - __builtin_clzll( allBits );
+    const int window = bits <= 16 ? 2 : 4, entries = 1 << window;
+    for ( int e = 2; e < entries; e++ ) {
+#pragma GCC unroll 8
+        for ( std::size_t l = 0; l < LANES; l++ ) table[e][l] = mont[l].multiply( table[e - 1][l], table[1][l] );
+    }
+
+    int position = ( bits - 1 ) / window * window;
+#pragma GCC unroll 8
+    for ( std::size_t l = 0; l < LANES; l++ ) x[l] = table[( d[l] >> position ) & ( entries - 1 )][l];
+    for ( position -= window; position >= 0; position -= window ) {
+        for ( int i = 0; i < window; i++ ) {
+#pragma GCC unroll 8
+            for ( std::size_t l = 0; l < LANES; l++ ) x[l] = mont[l].multiply( x[l], x[l] );
+        }
+#pragma GCC unroll 8
+        for ( std::size_t l = 0; l < LANES; l++ ) {
+            x[l] = mont[l].multiply( x[l], table[( d[l] >> position ) & ( entries - 1 )][l] );
+        }
+    }
+
+    int maxS = 0;
+    for ( std::size_t l = 0; l < LANES; l++ ) {
+        // a multiple of n says nothing; treat it as passing, as isMrPrime64 does
+        pass[l] = table[1][l] == 0 || x[l] == one[l] || x[l] == minusOne[l];
+        maxS = std::max( maxS, s[l] );
+    }
+    for ( int i = 1; i < maxS; i++ ) {
+        for ( std::size_t l = 0; l < LANES; l++ ) {
+            if ( pass[l] || i >= s[l] ) continue;
+            x[l] = mont[l].multiply( x[l], x[l] );
+            pass[l] = x[l] == minusOne[l];
+        }
+    }
+}
+
+/*
+ * Miller-Rabin over an array of candidates, same result as isMrPrime64.
+ * Bit i of mask (word i / 64) is set iff candidates[i] is prime;
+ * mask must hold (count + 63) / 64 words.
+ * Candidates surviving trial division are tested base by base, four
+ * lanes at a time, and only the survivors of one base go on to the next.
+ */
+inline void isMrPrimeBatch( const std::uint64_t* candidates, std::size_t count, std::uint64_t* mask ) {
+    static const std::size_t LANES = 4;
+    static constexpr auto trialPrimes = smallPrimes<12>();
+    static constexpr std::uint64_t bases[] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+    std::fill( mask, mask + ( count + 63 ) / 64, 0 );
+
+    std::vector<std::size_t> pending;
+    for ( std::size_t i = 0; i < count; i++ ) {
+        const std::uint64_t n = candidates[i];
+        bool decided = n < 2;
+        bool prime = false;
+        for ( std::size_t j = 0; !decided && j < trialPrimes.size(); j++ ) {
+            if ( n % trialPrimes[j] == 0 ) {
+                decided = true;
+                prime = n == trialPrimes[j];
+            }
+        }
+        if ( !decided && n < 37 * 37 ) decided = prime = true;
+        if ( prime ) mask[i / 64] |= 1ULL << ( i % 64 );
+        if ( !decided ) pending.push_back( i );
+    }
+
+    std::vector<Montgomery64> mont;
+    std::vector<std::uint64_t> d;
+    std::vector<int> s;
+    mont.reserve( pending.size() + LANES );
+    for ( std::size_t i : pending ) {
+        const std::uint64_t n = candidates[i];
+        mont.emplace_back( n );
+        s.push_back( __builtin_ctzll( n - 1 ) );
+        d.push_back( ( n - 1 ) >> s.back() );
+    }
+
+    bool pass[LANES];
+    for ( std::uint64_t a : bases ) {
+        // pad the last group by repeating the final lane
+        const std::size_t active = pending.size();
+        if ( active == 0 ) break;
+        for ( std::size_t l = active; l % LANES != 0; l++ ) {
+            mont.push_back( mont[active - 1] );
+            d.push_back( d[active - 1] );
+            s.push_back( s[active - 1] );
+        }
+
+        std::size_t kept = 0;
+        for ( std::size_t g = 0; g < active; g += LANES ) {
+            strongProbablePrimeLanes<LANES>( &mont[g], &d[g], &s[g], a, pass );
+            for ( std::size_t l = 0; l < LANES && g + l < active; l++ ) {
+                if ( !pass[l] ) continue;
+                pending[kept] = pending[g + l];
+                mont[kept] = mont[g + l];
+                d[kept] = d[g + l];
+                s[kept] = s[g + l];
+                kept++;
+            }
+        }
+        pending.resize( kept );
+        mont.erase( mont.begin() + kept, mont.end() );
+        d.resize( kept );
+        s.resize( kept );
+    }
+    for ( std::size_t i : pending ) mask[i / 64] |= 1ULL << ( i % 64 );
+}
+
 /*
  * Miller-Rabin primality test.
- * Accurate for n < 3,825,123,056,546,413,051
+ * Built-in integers up to 64 bits go to isMrPrime64 and are exact.
+ * Other types are accurate for n < 3,825,123,056,546,413,051
  */
 template<typename T, typename V = int>
 bool isMrPrime( T n ) {
-    std::vector<int> testCases;
-    if ( n < 1373653 ) {
-        testCases = {2, 3};
-    } else if ( n < 9080191 ) {
-        testCases = {31, 73};
-    } else if ( n < 4759123141ULL ) {
-        testCases = {2, 7, 61};
-    } else if ( n < 2152302398787ULL ) {
-        testCases = {2, 3, 5, 7, 11};
-    } else if ( n < 3474749660383ULL ) {
-        testCases = {2, 3, 5, 7, 11, 13};
+    if constexpr ( std::is_integral<T>::value && sizeof( T ) <= sizeof( std::uint64_t ) ) {
+        return n > 1 && isMrPrime64( (std::uint64_t) n );
     } else {
-        testCases = {2, 3, 5, 7, 11, 13, 17};
+        static constexpr std::array<int, 2> below1373653 = {2, 3};
+        static constexpr std::array<int, 2> below9080191 = {31, 73};
+        static constexpr std::array<int, 3> below4759123141 = {2, 7, 61};
+        static constexpr std::array<int, 5> below2152302398787 = {2, 3, 5, 7, 11};
+        static constexpr std::array<int, 6> below3474749660383 = {2, 3, 5, 7, 11, 13};
+        static constexpr std::array<int, 7> otherwise = {2, 3, 5, 7, 11, 13, 17};
+        if ( n < 1373653 ) return isMrPrime<T, V>( n, below1373653 );
+        if ( n < 9080191 ) return isMrPrime<T, V>( n, below9080191 );
+        if ( n < 4759123141ULL ) return isMrPrime<T, V>( n, below4759123141 );
+        if ( n < 2152302398787ULL ) return isMrPrime<T, V>( n, below2152302398787 );
+        if ( n < 3474749660383ULL ) return isMrPrime<T, V>( n, below3474749660383 );
+        return isMrPrime<T, V>( n, otherwise );
+    }
+}
+
+/*
+ * Finds a non-trivial factor of an odd composite n.
+ * Brent's variant of Pollard's rho on f(x) = x^2 + c in Montgomery form.
+ * The differences |x - y| are multiplied together and one gcd is taken
+ * per 128 steps; if that overshoots to n, the last stretch is replayed
+ * one gcd at a time. A failed c moves on to c + 1.
+ */
+inline std::uint64_t pollardBrent( std::uint64_t n ) {
+    if ( ( n & 1 ) == 0 ) return 2;
+    const std::uint64_t batch = 128;
+    const Montgomery64 mont( n );
+    for ( std::uint64_t c = 1; ; c++ ) {
+        const std::uint64_t cm = mont.toMontgomery( c );
+        auto f = [&mont, cm]( std::uint64_t x ) { return mont.add( mont.multiply( x, x ), cm ); };
+        auto distance = []( std::uint64_t x, std::uint64_t y ) { return x > y ? x - y : y - x; };
+
+        std::uint64_t x, y = mont.toMontgomery( 2 ), ys = y, q = mont.one(), g = 1;
+        for ( std::uint64_t r = 1; g == 1; r <<= 1 ) {
+            x = y;
+            for ( std::uint64_t i = 0; i < r; i++ ) y = f( y );
+            for ( std::uint64_t k = 0; k < r && g == 1; k += batch ) {
+                ys = y;
+                for ( std::uint64_t i = 0; i < std::min( batch, r - k ); i++ ) {
+                    y = f( y );
+                    q = mont.multiply( q, distance( x, y ) );
+                }
+                g = binaryGcd( q, n );
+            }
+        }
+        if ( g == n ) {
+            do {
+                ys = f( ys );
+                g = binaryGcd( distance( x, ys ), n );
+            } while ( g == 1 );
+        }
+        if ( g != n ) return g;
     }
-    return isMrPrime<T, V>( n, testCases );
 }
 
+/*
+ * Prime factorisation of any 64-bit n > 0 without a sieve.
+ * Trial division by primes below 100, then isMrPrime64 and pollardBrent
+ * on whatever is left. Returns (prime, exponent) pairs in ascending order.
+ */
+inline PrimeFactorization<std::uint64_t> factorize( std::uint64_t n ) {
+    static constexpr auto trialPrimes = smallPrimes<25>(); // the primes below 100
+    if ( n == 0 ) throw std::domain_error("Cannot factorize zero");
+    PrimeFactorization<std::uint64_t> result;
+    for ( std::uint64_t p : trialPrimes ) {
+        while ( n % p == 0 ) {
+            result.add( p );
+            n /= p;
+        }
+    }
+    if ( n == 1 ) return result;
+
+    // every remaining factor exceeds 100, so there are at most 9 of them (101^10 > 2^64)
+    std::uint64_t primes[64], pending[64];
+    int primeCount = 0, pendingCount = 0;
+    pending[pendingCount++] = n;
+    while ( pendingCount > 0 ) {
+        std::uint64_t m = pending[--pendingCount];
+        if ( m < 100 * 100 || isMrPrime64( m ) ) {
+            primes[primeCount++] = m;
+        } else {
+            std::uint64_t d = pollardBrent( m );
+            pending[pendingCount++] = d;
+            pending[pendingCount++] = m / d;
+        }
+    }
+    std::sort( primes, primes + primeCount );
+    for ( int i = 0; i < primeCount; i++ ) result.add( primes[i] );
+    return result;
+}
+
+/*
+ * Segmented Sieve of Eratosthenes over [low, high).
+ * Only odd numbers are stored, and the range is processed one cache sized
+ * block at a time. Each sieving prime carries the offset of its next odd
+ * multiple over from one block to the next, so no block ever touches memory
+ * outside itself.
+ * Sieving primes are extended on demand, so high may be left unbounded.
+ *
+ * Usage:
+ *   SegmentedSieve sieve( 0, upper );
+ *   while ( sieve.nextBlock() ) sieve.forEachPrime( [&]( std::uint64_t p ) { ... } );
+ */
+class SegmentedSieve {
+public:
+    static const std::size_t DEFAULT_BLOCK_SIZE = 32768; // bytes; fits in L1
+
+    SegmentedSieve( std::uint64_t low, std::uint64_t high = UINT64_MAX,
+                    std::size_t blockSize = DEFAULT_BLOCK_SIZE )
+        : low( low ), high( high ), blockStart( alignedStart( low ) ), blockEnd( alignedStart( low ) ),
+          blockSize( blockSize ), blockLength( 0 ), flags( blockSize ), baseLimit( 2 ) {}
+
+    /*
+     * Sieves the next block; returns false once the range is exhausted
+     */
+    bool nextBlock() {
+        if ( blockEnd >= high ) return false;
+        for ( std::size_t i = 0; i < offsets.size(); i++ ) offsets[i] -= blockLength;
+        blockStart = blockEnd;
+        blockLength = std::min<std::uint64_t>( blockSize, ( high - blockStart ) / 2 );
+        if ( blockLength == 0 ) return false;
+        blockEnd = blockStart + 2 * blockLength;
+
+        std::fill( flags.begin(), flags.begin() + blockLength, 1 );
+        if ( blockStart == 0 ) flags[0] = 0; // 1 is not prime
+
+        activateBasePrimes();
+        unsigned char* block = flags.data();
+        for ( std::size_t j = 0; j < offsets.size(); j++ ) {
+            std::uint64_t i = offsets[j];
+            const std::uint64_t p = basePrimes[j];
+            for ( ; i < blockLength; i += p ) block[i] = 0;
+            offsets[j] = i;
+        }
+        return true;
+    }
+
+    /*
+     * Calls f on every prime in the current block, in ascending order
+     */
+    template<typename F>
+    void forEachPrime( F f ) const {
+        if ( blockStart == 0 && low <= 2 && high > 2 ) f( (std::uint64_t) 2 );
+        std::size_t begin = low > blockStart ? ( low - blockStart ) / 2 : 0;
+        std::size_t end = blockEnd > high ? ( high - blockStart ) / 2 : blockLength;
+        for ( std::size_t i = begin; i < end; i++ ) {
+            if ( flags[i] ) f( blockStart + 2 * i + 1 );
+        }
+    }
+
+    // the current block covers [blockLow(), blockHigh())
+    std::uint64_t blockLow() const { return std::max( blockStart, low ); }
+    std::uint64_t blockHigh() const { return std::min( blockEnd, high ); }
+
+private:
+    // blocks start on an even number; ranges containing 2 start from 0
+    static std::uint64_t alignedStart( std::uint64_t low ) {
+        return low <= 2 ? 0 : low & ~1ULL;
+    }
+
+    /*
+     * Start sieving with every odd prime whose square lies below the block end.
+     * The first multiple is found relative to the current block, so any
+     * starting point (and therefore any independent segment) works.
+     */
+    void activateBasePrimes() {
+        std::uint64_t needed = integerSqrt( blockEnd - 1 );
+        if ( needed > baseLimit ) extendBasePrimes( std::max( needed, 2 * baseLimit ) );
+        while ( offsets.size() < basePrimes.size() ) {
+            const std::uint64_t p = basePrimes[offsets.size()];
+            if ( p > needed ) break;
+            std::uint64_t m = std::max( p * p, ( blockStart + p - 1 ) / p * p );
+            if ( ( m & 1 ) == 0 ) m += p;
+            offsets.push_back( ( m - blockStart - 1 ) / 2 );
+        }
+    }
+
+    /*
+     * Appends the odd primes in (baseLimit, limit] using a plain sieve
+     */
+    void extendBasePrimes( std::uint64_t limit ) {
+        std::vector<bool> composite( limit + 1, false );
+        for ( std::uint64_t i = 3; i * i <= limit; i += 2 ) {
+            if ( composite[i] ) continue;
+            for ( std::uint64_t j = i * i; j <= limit; j += 2 * i ) composite[j] = true;
+        }
+        for ( std::uint64_t i = baseLimit + 1 + ( baseLimit & 1 ); i <= limit; i += 2 ) {
+            if ( !composite[i] ) basePrimes.push_back( i );
+        }
+        baseLimit = limit;
+    }
+
+    std::uint64_t low, high;
+    std::uint64_t blockStart, blockEnd;
+    std::size_t blockSize, blockLength;
+    std::vector<unsigned char> flags; // flags[i] <-> blockStart + 2i + 1
+    std::vector<std::uint64_t> basePrimes;
+    std::vector<std::uint64_t> offsets; // next odd multiple of basePrimes[j], as a block index
+    std::uint64_t baseLimit;
+};
+
 /*
  * Generate lookup table that returns if a number is prime
- * Sieve of Eratosthenes
+ * Sieve of Eratosthenes (segmented; see SegmentedSieve)
  */
 template<typename T>
 std::vector<bool> generatePrimalityTable( T upper ) {
-    std::vector<bool> primes(upper, true);
-    primes[0] = false;
-    primes[1] = false;
-    for ( T i = 2; i * i < upper; i++ ) {
-        if ( primes[i] ) {
-            for ( T j = i*i; j < upper; j += i ) {
-                primes[j] = false;
-            }
-        }
+    std::vector<bool> primes( upper, false );
+    SegmentedSieve sieve( 0, upper );
+    while ( sieve.nextBlock() ) {
+        sieve.forEachPrime( [&primes]( std::uint64_t p ) { primes[p] = true; } );
     }
     return primes;
 }
 
 template<typename T>
 std::vector<T> generatePrimeList( T upper ) {
-    std::vector<bool> primeTable = generatePrimalityTable<T>( upper );
     std::vector<T> primes;
-    T i = 0;
-    for ( auto it = primeTable.begin(); it != primeTable.end(); ++it ) {
-        if ( *it ) primes.push_back( i );
-        i++;
+    SegmentedSieve sieve( 0, upper );
+    while ( sieve.nextBlock() ) {
+        sieve.forEachPrime( [&primes]( std::uint64_t p ) { primes.push_back( (T) p ); } );
+    }
+    return primes;
+}
+
+/*
+ * Lazily generated primes in [low, high), sieved one block at a time.
+ * Memory use grows with the primes actually consumed (one block plus the
+ * sieving primes up to sqrt of the current position), not with any guessed
+ * upper limit.
+ *
+ * Either pull primes with next(), or use in a range-for loop:
+ *   for ( std::uint64_t p : PrimeStream() ) { if ( ... ) break; }
+ */
+class PrimeStream {
+public:
+    PrimeStream( std::uint64_t low = 0, std::uint64_t high = UINT64_MAX )
+        : sieve( low, high ), position( 0 ) {}
+
+    /*
+     * Returns the next prime, or 0 once the range is exhausted
+     */
+    std::uint64_t next() {
+        while ( position == buffer.size() ) {
+            buffer.clear();
+            position = 0;
+            if ( !sieve.nextBlock() ) return 0;
+            sieve.forEachPrime( [this]( std::uint64_t p ) { buffer.push_back( p ); } );
+        }
+        return buffer[position++];
+    }
+
+    class iterator {
+    public:
+        std::uint64_t operator*() const { return value; }
+        bool operator!=( const iterator& other ) const { return value != other.value; }
+        bool operator==( const iterator& other ) const { return value == other.value; }
+        iterator& operator++() {
+            value = stream->next();
+            return *this;
+        }
+
+    private:
+        friend class PrimeStream;
+        iterator( PrimeStream* stream, std::uint64_t value ) : stream( stream ), value( value ) {}
+
+        PrimeStream* stream;
+        std::uint64_t value;
+    };
+
+    iterator begin() { return iterator( this, next() ); }
+    iterator end() { return iterator( this, 0 ); }
+
+private:
+    SegmentedSieve sieve;
+    std::vector<std::uint64_t> buffer;
+    std::size_t position;
+};
+
+/*
+ * Upper bound for the nth prime (p_1 = 2)
+ * Rosser (1941): p_n < n(ln n + ln ln n) for n >= 6
+ * Dusart (1999): p_n <= n(ln n + ln ln n - 0.9484) for n >= 39017
+ */
+inline std::uint64_t nthPrimeUpperBound( std::uint64_t n ) {
+    static constexpr auto exact = smallPrimes<5>();
+    if ( n < 6 ) return n == 0 ? 0 : exact[n - 1];
+    double logN = std::log( (double) n );
+    double bound = n * ( logN + std::log( logN ) - ( n >= 39017 ? 0.9484 : 0.0 ) );
+    return (std::uint64_t) std::ceil( bound ) + 1; // +1 absorbs floating point error
+}
+
+/*
+ * The first n primes, sieving no further than the proven bound on p_n
+ */
+template<typename T>
+std::vector<T> firstNPrimes( std::size_t n ) {
+    std::vector<T> primes;
+    primes.reserve( n );
+    SegmentedSieve sieve( 0, nthPrimeUpperBound( n ) + 1 );
+    while ( primes.size() < n && sieve.nextBlock() ) {
+        sieve.forEachPrime( [&primes, n]( std::uint64_t p ) {
+            if ( primes.size() < n ) primes.push_back( (T) p );
+        } );
     }
     return primes;
 }
 
-template<typename T, typename It = typename std::map<T, int>::iterator>
-inline void divisorsCalculation( std::map<T, int>& primeFactors,
-                          It currentElement,
-                          T currentResult,
-                          std::vector<T>* results ) {
+/*
+ * As generatePrimeList, but [0, upper) is split into disjoint segments that
+ * are sieved independently on worker threads and then concatenated in order,
+ * so the output is identical to the serial version.
+ * There are several segments per thread so that threads finishing early
+ * pick up more work.
+ */
+template<typename T>
+std::vector<T> generatePrimeListParallel( T upper, unsigned int threads = std::thread::hardware_concurrency() ) {
+    const std::uint64_t minSegment = 2 * SegmentedSieve::DEFAULT_BLOCK_SIZE;
+    if ( threads <= 1 || (std::uint64_t) upper < 2 * minSegment ) return generatePrimeList<T>( upper );
+
+    std::uint64_t segmentCount = std::min<std::uint64_t>( 8 * threads, upper / minSegment );
+    std::uint64_t segmentWidth = ( ( upper + segmentCount - 1 ) / segmentCount + 1 ) & ~1ULL;
+    segmentCount = ( upper + segmentWidth - 1 ) / segmentWidth;
+
+    std::vector< std::vector<T> > segments( segmentCount );
+    std::atomic<std::uint64_t> nextSegment( 0 );
+    auto worker = [&]() {
+        std::uint64_t i;
+        while ( ( i = nextSegment++ ) < segmentCount ) {
+            std::uint64_t low = i * segmentWidth;
+            std::uint64_t high = std::min<std::uint64_t>( low + segmentWidth, upper );
+            std::vector<T>& primes = segments[i];
+            SegmentedSieve sieve( low, high );
+            while ( sieve.nextBlock() ) {
+                sieve.forEachPrime( [&primes]( std::uint64_t p ) { primes.push_back( (T) p ); } );
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for ( unsigned int t = 1; t < threads; t++ ) pool.emplace_back( worker );
+    worker();
+    for ( auto& thread : pool ) thread.join();
+
+    std::size_t total = 0;
+    for ( auto& segment : segments ) total += segment.size();
+    std::vector<T> primes;
+    primes.reserve( total );
+    for ( auto& segment : segments ) primes.insert( primes.end(), segment.begin(), segment.end() );
+    return primes;
+}
+
+/*
+ * Process-wide cache of the longest prime list generated so far, so that
+ * a program running several solutions (the runner) sieves once and later
+ * solutions copy a prefix. Off unless enable() is called, so a single
+ * solution binary still times its own sieve.
+ */
+class SharedPrimeList {
+public:
+    static void enable( bool on = true ) {
+        SharedPrimeList& s = instance();
+        std::lock_guard<std::mutex> lock( s.mutex );
+        s.enabled = on;
+        if ( !on ) {
+            s.primes = std::vector<std::uint32_t>();
+            s.upper = 0;
+        }
+    }
+
+    /*
+     * Same result as generatePrimeList<T>( upper )
+     */
+    template<typename T>
+    static std::vector<T> get( T upper ) {
+        SharedPrimeList& s = instance();
+        std::unique_lock<std::mutex> lock( s.mutex );
+        if ( !s.enabled || (std::uint64_t) upper > UINT32_MAX ) {
+            // nothing is cached, so other callers need not wait for this sieve
+            lock.unlock();
+            return generatePrimeListParallel<T>( upper );
+        }
+        if ( s.upper < (std::uint64_t) upper ) {
+            s.primes = generatePrimeListParallel<std::uint32_t>( (std::uint32_t) upper );
+            s.upper = upper;
+        }
+        auto end = std::lower_bound( s.primes.begin(), s.primes.end(), (std::uint64_t) upper );
+        return std::vector<T>( s.primes.begin(), end );
+    }
+
+private:
+    static SharedPrimeList& instance() {
+        static SharedPrimeList shared;
+        return shared;
+    }
+
+    bool enabled = false;
+    std::uint64_t upper = 0;
+    std::vector<std::uint32_t> primes;
+    std::mutex mutex;
+};
+
+/*
+ * Primality lookup table that only stores integers coprime to 30.
+ * Each byte covers 30 consecutive integers, one bit per residue in
+ * {1, 7, 11, 13, 17, 19, 23, 29}, so the table is ~3.75x smaller than
+ * a std::vector<bool> of the same range.
+ * Filled from SegmentedSieve, so building it never needs more than the
+ * table itself plus one sieve block.
+ */
+class PrimalityBitset {
+public:
+    PrimalityBitset( std::uint64_t upper ) : upper( upper ), bits( ( upper + 29 ) / 30, 0 ) {
+        SegmentedSieve sieve( 7, upper );
+        while ( sieve.nextBlock() ) {
+            sieve.forEachPrime( [this]( std::uint64_t p ) {
+                bits[p / 30] |= (unsigned char)( 1 << residueIndex( p % 30 ) );
+            } );
+        }
+    }
+
+    /*
+     * n must be less than size()
+     */
+    bool test( std::uint64_t n ) const {
+        int index = residueIndex( n % 30 );
+        if ( index < 0 ) return n == 2 || n == 3 || n == 5;
+        return ( bits[n / 30] >> index ) & 1;
+    }
+
+    bool operator[]( std::uint64_t n ) const { return test( n ); }
+
+    std::uint64_t size() const { return upper; }
+
+    /*
+     * Iterates over the primes in the table, in ascending order
+     */
+    class const_iterator {
+    public:
+        std::uint64_t operator*() const { return value; }
+        bool operator!=( const const_iterator& other ) const { return value != other.value; }
+        bool operator==( const const_iterator& other ) const { return value == other.value; }
+
+        const_iterator& operator++() {
+            if ( value < 5 ) {
+                value = value == 2 ? 3 : 5;
+                if ( value >= table->upper ) value = table->upper;
+                return *this;
+            }
+            std::uint64_t byte = value / 30;
+            unsigned int remaining = table->bits[byte];
+            if ( value >= 7 ) remaining &= ~( ( 2u << residueIndex( value % 30 ) ) - 1 );
+            while ( remaining == 0 && ++byte < table->bits.size() ) remaining = table->bits[byte];
+            if ( remaining == 0 ) {
+                value = table->upper;
+            } else {
+                value = byte * 30 + residues()[__builtin_ctz( remaining )];
+                if ( value >= table->upper ) value = table->upper;
+            }
+            return *this;
+        }
+
+    private:
+        friend class PrimalityBitset;
+        const_iterator( const PrimalityBitset* table, std::uint64_t value ) : table( table ), value( value ) {}
+
+        const PrimalityBitset* table;
+        std::uint64_t value;
+    };
+
+    const_iterator begin() const { return const_iterator( this, upper > 2 ? 2 : upper ); }
+    const_iterator end() const { return const_iterator( this, upper ); }
+
+private:
+    static const int* residues() {
+        static const int values[8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+        return values;
+    }
+
+    // bit position of a residue mod 30, or -1 if it shares a factor with 30
+    static int residueIndex( std::uint64_t r ) {
+        static const signed char index[30] = {
+            -1,  0, -1, -1, -1, -1, -1,  1, -1, -1,
+            -1,  2, -1,  3, -1, -1, -1,  4, -1,  5,
+            -1, -1, -1,  6, -1, -1, -1, -1, -1,  7
+        };
+        return index[r];
+    }
+
+    std::uint64_t upper;
+    std::vector<unsigned char> bits;
+};
+
+template<typename T>
+bool isPrime( T n, const PrimalityBitset& table ) {
+    if ( n < 2 ) return false;
+    if ( (std::uint64_t) n < table.size() ) return table.test( n );
+    for ( std::uint64_t p : table ) {
+        if ( p * p > (std::uint64_t) n ) return true;
+        if ( n % (T) p == 0 ) return false;
+    }
+    if ( table.size() < 3 ) return isPrime<T>( n );
+    // no prime below table.size() divides n; go on with odd divisors
+    for ( std::uint64_t d = table.size() | 1; d <= (std::uint64_t) n / d; d += 2 ) {
+        if ( n % (T) d == 0 ) return false;
+    }
+    return true;
+}
+
+/*
+ * Index over the O(sqrt n) distinct values of floor(n / i).
+ * A value v <= sqrt(n) lives at slot v; a larger value n / i at slot root + i.
+ * Used as the working set for the Lucy_Hedgehog style functions below.
+ */
+class FloorValueIndex {
+public:
+    FloorValueIndex( std::uint64_t n ) : n( n ), root( integerSqrt( n ) ) {}
 
-    if ( currentElement == primeFactors.end() ) {
-        results->push_back( currentResult );
-        return;
+    std::size_t slots() const { return 2 * root + 1; }
+    std::size_t slot( std::uint64_t v ) const { return v <= root ? v : root + n / v; }
+    std::uint64_t value( std::size_t slot ) const { return slot <= root ? slot : n / ( slot - root ); }
+
+    /*
+     * Calls f(slot of v, slot of v / p) for every v >= p^2, in descending
+     * order of v. Avoids division for the large values.
+     */
+    template<typename F>
+    void forEachSieveStep( std::uint64_t p, F f ) const {
+        const std::uint64_t square = p * p;
+        const std::uint64_t iEnd = std::min( root, n / square );
+        for ( std::uint64_t i = 1; i <= iEnd; i++ ) {
+            const std::uint64_t d = i * p;
+            f( root + i, d <= root ? root + d : n / d );
+        }
+        for ( std::uint64_t v = root; v >= square; v-- ) f( v, v / p );
     }
-    for ( int i = 0; i <= currentElement->second; i++ ) {
-        divisorsCalculation( primeFactors, ++currentElement, currentResult, results );
-        currentResult *= (--currentElement)->first;
+
+    const std::uint64_t n, root;
+};
+
+/*
+ * Lucy_Hedgehog's method: sum of f(p) over primes p <= n in O(n^(3/4))
+ * time and O(sqrt n) memory, for a completely multiplicative f.
+ * prefix(v) must give sum of f(k) for 2 <= k <= v.
+ *
+ * Each entry S(v) starts as prefix(v). Sieving by prime p removes the
+ * numbers whose smallest prime factor is p:
+ *   S(v) -= f(p) * (S(v / p) - S(p - 1))   for v >= p^2
+ * Entries are updated in descending order, so S(v / p) still holds the
+ * value from before p was sieved.
+ */
+template<typename T, typename Prefix, typename Weight>
+T lucyPrimeSum( std::uint64_t n, Prefix prefix, Weight f ) {
+    if ( n < 2 ) return T( 0 );
+    FloorValueIndex index( n );
+    std::vector<T> S( index.slots() );
+    for ( std::size_t i = 1; i < S.size(); i++ ) S[i] = prefix( index.value( i ) );
+
+    for ( std::uint64_t p : generatePrimeList<std::uint64_t>( index.root + 1 ) ) {
+        const T before = S[p - 1];
+        const T weight = f( p );
+        index.forEachSieveStep( p, [&S, &before, &weight]( std::size_t v, std::size_t quotient ) {
+            S[v] -= weight * ( S[quotient] - before );
+        } );
     }
+    return S[index.slot( n )];
 }
 
-template<typename T, typename It = typename std::vector<T>::const_iterator>
+/*
+ * Number of primes <= n
+ */
+inline std::uint64_t primePi( std::uint64_t n ) {
+    return lucyPrimeSum<std::uint64_t>( n,
+        []( std::uint64_t v ) { return v - 1; },
+        []( std::uint64_t ) { return std::uint64_t( 1 ); } );
+}
+
+/*
+ * Sum of primes <= n
+ * The result exceeds 64 bits for n > ~4e10; T = unsigned __int128 covers
+ * any 64-bit n. Narrower unsigned T gives the sum modulo 2^bits.
+ */
+template<typename T = unsigned __int128>
+T primeSum( std::uint64_t n ) {
+    return lucyPrimeSum<T>( n,
+        []( std::uint64_t v ) {
+            // v(v+1)/2 - 1, halving before multiplying so T may wrap
+            return ( v % 2 == 0 ? T( v / 2 ) * T( v + 1 ) : T( v ) * T( ( v + 1 ) / 2 ) ) - T( 1 );
+        },
+        []( std::uint64_t p ) { return T( p ); } );
+}
+
+/*
+ * Counts of primes <= n in each residue class modulo m
+ * result[r] = pi(n; m, r)
+ * Sieving by p maps the unsieved numbers of class r into class p*r mod m,
+ * so one running count is kept per class. O(m * n^(3/4)) time.
+ */
+inline std::vector<std::uint64_t> primePiByResidue( std::uint64_t n, std::uint64_t m ) {
+    if ( m == 0 ) throw std::domain_error("Modulus must be positive");
+    if ( n < 2 ) return std::vector<std::uint64_t>( m, 0 );
+
+    FloorValueIndex index( n );
+    // counts for slot s, class r at S[s * m + r]
+    std::vector<std::uint64_t> S( index.slots() * m );
+    for ( std::size_t i = 1; i < index.slots(); i++ ) {
+        // count of k in [2, v] with k == r mod m
+        const std::uint64_t v = index.value( i );
+        std::uint64_t* counts = &S[i * m];
+        for ( std::uint64_t r = 0; r < m; r++ ) counts[r] = v / m + ( r <= v % m ? 1 : 0 );
+        counts[0]--;
+        counts[1 % m]--;
+    }
+
+    std::vector<std::uint64_t> classOf( m );
+    for ( std::uint64_t p : generatePrimeList<std::uint64_t>( index.root + 1 ) ) {
+        for ( std::uint64_t r = 0; r < m; r++ ) classOf[r] = ( p % m ) * r % m;
+        const std::vector<std::uint64_t> before( &S[( p - 1 ) * m], &S[p * m] );
+        index.forEachSieveStep( p, [&]( std::size_t v, std::size_t quotient ) {
+            std::uint64_t* entry = &S[v * m];
+            const std::uint64_t* removed = &S[quotient * m];
+            for ( std::uint64_t r = 0; r < m; r++ ) entry[classOf[r]] -= removed[r] - before[r];
+        } );
+    }
+    const std::size_t n_slot = index.slot( n );
+    return std::vector<std::uint64_t>( &S[n_slot * m], &S[n_slot * m] + m );
+}
+
+/*
+ * Number of primes p <= n with p == r mod m
+ */
+inline std::uint64_t primePi( std::uint64_t n, std::uint64_t m, std::uint64_t r ) {
+    return primePiByResidue( n, m )[r % m];
+}
+
+/*
+ * Product of two factorisations, both in ascending order
+ */
+template<typename T>
+PrimeFactorization<T> multiplyFactorizations( const PrimeFactorization<T>& a, const PrimeFactorization<T>& b ) {
+    PrimeFactorization<T> result;
+    const std::pair<T, int>* i = a.begin();
+    const std::pair<T, int>* j = b.begin();
+    while ( i != a.end() || j != b.end() ) {
+        if ( j == b.end() || ( i != a.end() && i->first <= j->first ) ) {
+            result.add( i->first, i->second );
+            ++i;
+        } else {
+            result.add( j->first, j->second );
+            ++j;
+        }
+    }
+    return result;
+}
+
+/*
+ * Writes the divisors d of n with low <= d <= high into divisors, replacing
+ * its contents; n is given by its factorisation. Reuse the same vector to
+ * avoid allocation.
+ * Built iteratively: each prime power multiplies the divisors found so far.
+ * Divisors above high are dropped as soon as they appear, since later
+ * primes can only make them larger.
+ * Order is unspecified unless sorted is set.
+ */
+template<typename T>
+void generateDivisors( const PrimeFactorization<T>& factors, std::vector<T>* divisors,
+                       T low = 1, T high = std::numeric_limits<T>::max(), bool sorted = false ) {
+    divisors->clear();
+    if ( high < 1 ) return;
+    divisors->push_back( 1 );
+    for ( const auto& factor : factors ) {
+        std::size_t begin = 0;
+        for ( int e = 0; e < factor.second; e++ ) {
+            const std::size_t end = divisors->size();
+            for ( std::size_t i = begin; i < end; i++ ) {
+                T d = (*divisors)[i];
+                if ( d <= high / factor.first ) divisors->push_back( d * factor.first );
+            }
+            begin = end;
+        }
+    }
+    if ( low > 1 ) {
+        divisors->erase( std::remove_if( divisors->begin(), divisors->end(),
+                                         [low]( T d ) { return d < low; } ), divisors->end() );
+    }
+    if ( sorted ) std::sort( divisors->begin(), divisors->end() );
+}
+
+/*
+ * Number of divisors; product of (e + 1)
+ */
+template<typename T>
+T divisorCount( const PrimeFactorization<T>& factors ) {
+    T count = 1;
+    for ( const auto& factor : factors ) count *= factor.second + 1;
+    return count;
+}
+
+/*
+ * Sum of divisors; product of (1 + p + ... + p^e)
+ */
+template<typename T>
+T divisorSum( const PrimeFactorization<T>& factors ) {
+    T sum = 1;
+    for ( const auto& factor : factors ) {
+        T term = 1, power = 1;
+        for ( int e = 0; e < factor.second; e++ ) {
+            power *= factor.first;
+            term += power;
+        }
+        sum *= term;
+    }
+    return sum;
+}
+
+/*
+ * All divisors from a list of prime factors (with multiplicity, any order)
+ */
+template<typename T>
 inline std::vector<T> calculateAllDivisors( std::vector<T> primeFactors ) {
-    std::map<T, int> primes;
-    for ( It it = primeFactors.begin(); it != primeFactors.end(); ++it ) {
-        primes[*it]++;
+    std::sort( primeFactors.begin(), primeFactors.end() );
+    PrimeFactorization<T> factors;
+    for ( const T& p : primeFactors ) {
+        if ( p > 1 ) factors.add( p );
     }
     std::vector<T> results;
-    divisorsCalculation( primes, primes.begin(), T(1), &results );
+    generateDivisors( factors, &results );
     return results;
 }
 
 /*
- * Gives prime factors for all numbers up to its length.
- * Calculated in sieve like fashion.
+ * Storage policies for PrimeFactorsList.
+ * Each records one prime factor for every integer below length.
+ * split(k, &cofactor) returns that prime and sets cofactor = k / prime;
+ * for k == 1 it returns 1 with cofactor 1.
+ * withoutLargest(k) is k / (largest prime factor of k) whatever is
+ * stored, with 0 and 1 mapping to themselves.
  */
-template<typename T>
-class PrimeFactorsList {
+
+/*
+ * Stores k / (largest prime factor of k) as S; 1 marks a prime.
+ * Factors decode in descending order.
+ */
+template<typename S>
+class CofactorStorage {
 public:
-    PrimeFactorsList( std::size_t length ) {
-        size = length;
-        factors = std::vector<T>( size, 0 );
+    CofactorStorage( std::size_t length ) : factors( length, 0 ) {
         factors[1] = 1;
         std::size_t n = 2;
         do {
             if ( factors[n] == 0 ) {
-                for ( std::size_t i = 1; i <= ( (size - 1) / n ); i++ ) {
+                for ( std::size_t i = 1; i <= ( (length - 1) / n ); i++ ) {
                     factors[i*n] = i;
                 }
             }
-        } while ( n++ < size - 1 );
+        } while ( n++ < length - 1 );
+    }
+
+    std::size_t split( std::size_t k, std::size_t* cofactor ) const {
+        *cofactor = factors[k];
+        return k / *cofactor;
+    }
+
+    std::size_t withoutLargest( std::size_t k ) const { return factors[k]; }
+
+    bool isPrime( std::size_t k ) const { return factors[k] == 1; }
+
+private:
+    std::vector<S> factors;
+};
+
+/*
+ * Stores the smallest prime factor as S; 0 marks a prime (or 0, 1).
+ * The smallest factor of a composite k is at most sqrt(k), so
+ * uint16_t covers tables up to 2^32 at 2 bytes per entry.
+ * Factors decode in ascending order.
+ */
+template<typename S>
+class SmallestFactorStorage {
+public:
+    SmallestFactorStorage( std::size_t length ) : factors( length, 0 ) {
+        std::uint64_t root = length < 2 ? 0 : integerSqrt( length - 1 );
+        if ( root > std::numeric_limits<S>::max() ) throw std::length_error("Table too long for storage type");
+        for ( std::uint64_t p = 2; p <= root; p++ ) {
+            if ( factors[p] != 0 ) continue;
+            for ( std::uint64_t j = p * p; j < length; j += p ) {
+                if ( factors[j] == 0 ) factors[j] = (S) p;
+            }
+        }
+    }
+
+    std::size_t split( std::size_t k, std::size_t* cofactor ) const {
+        std::size_t p = factors[k] == 0 ? k : factors[k];
+        *cofactor = k / p;
+        return p;
     }
 
+    // ascending order, so the largest factor is the last one split off
+    std::size_t withoutLargest( std::size_t k ) const {
+        if ( k < 2 ) return k;
+        std::size_t p = 1;
+        for ( std::size_t rest = k; rest != 1; ) p = split( rest, &rest );
+        return k / p;
+    }
+
+    bool isPrime( std::size_t k ) const { return k > 1 && factors[k] == 0; }
+
+private:
+    std::vector<S> factors;
+};
+
+/*
+ * Stores the smallest prime factor as (1 + its index in the list of primes),
+ * 0 marking a prime. A uint16_t index reaches the 65535th prime (821641),
+ * so tables up to ~6.7e11 fit at 2 bytes per entry.
+ * Factors decode in ascending order.
+ */
+template<typename S>
+class PrimeIndexStorage {
+public:
+    PrimeIndexStorage( std::size_t length ) : factors( length, 0 ) {
+        primes = generatePrimeList<std::uint64_t>( length < 2 ? 0 : integerSqrt( length - 1 ) + 1 );
+        if ( primes.size() > std::numeric_limits<S>::max() ) throw std::length_error("Table too long for storage type");
+        for ( std::size_t i = 0; i < primes.size(); i++ ) {
+            const std::uint64_t p = primes[i];
+            for ( std::uint64_t j = p * p; j < length; j += p ) {
+                if ( factors[j] == 0 ) factors[j] = (S)( i + 1 );
+            }
+        }
+    }
+
+    std::size_t split( std::size_t k, std::size_t* cofactor ) const {
+        std::size_t p = factors[k] == 0 ? k : primes[factors[k] - 1];
+        *cofactor = k / p;
+        return p;
+    }
+
+    // ascending order, so the largest factor is the last one split off
+    std::size_t withoutLargest( std::size_t k ) const {
+        if ( k < 2 ) return k;
+        std::size_t p = 1;
+        for ( std::size_t rest = k; rest != 1; ) p = split( rest, &rest );
+        return k / p;
+    }
+
+    bool isPrime( std::size_t k ) const { return k > 1 && factors[k] == 0; }
+
+private:
+    std::vector<S> factors;
+    std::vector<std::uint64_t> primes;
+};
+
+/*
+ * Gives prime factors for all numbers up to its length.
+ * Calculated in sieve like fashion.
+ * T is the type handed out; Storage decides how the table is held
+ * (see the storage policies above). The default keeps one T per integer.
+ */
+template<typename T, typename Storage = CofactorStorage<T> >
+class PrimeFactorsList {
+public:
+    PrimeFactorsList( std::size_t length ) : storage( length ), size( length ) {}
+
     ~PrimeFactorsList() {}
 
     const std::vector<T> operator[]( std::size_t index ) const {
         if ( index >= size ) throw std::out_of_range("Index out of range");
         std::vector<T> primeFactors;
-        int factor = index;
+        std::size_t factor = index;
         do {
-            int nextFactor = factors[factor];
-            primeFactors.push_back( factor / nextFactor );
+            std::size_t nextFactor;
+            primeFactors.push_back( storage.split( factor, &nextFactor ) );
             factor = nextFactor;
         } while ( factor != 1 );
         return primeFactors;
     }
 
+    /*
+     * Calls f on each prime factor of index (including multiplicity),
+     * in the same order as operator[] but without allocating.
+     * Calls nothing for index 1.
+     */
+    template<typename F>
+    void forEachFactor( std::size_t index, F f ) const {
+        if ( index >= size ) throw std::out_of_range("Index out of range");
+        std::size_t factor = index;
+        while ( factor != 1 ) {
+            std::size_t nextFactor;
+            f( (T) storage.split( factor, &nextFactor ) );
+            factor = nextFactor;
+        }
+    }
+
+    /*
+     * Writes the prime factors of index into out, replacing its contents.
+     * Reusing the same vector avoids allocation once it has grown.
+     */
+    void getFactors( std::size_t index, std::vector<T>* out ) const {
+        out->clear();
+        forEachFactor( index, [out]( T p ) { out->push_back( p ); } );
+    }
+
+    /*
+     * Factorisation of index as (prime, exponent) pairs in ascending order
+     */
+    PrimeFactorization<T> factorize( std::size_t index ) const {
+        PrimeFactorization<T> result;
+        forEachFactor( index, [&result]( T p ) { result.add( p ); } );
+        if ( result.size() > 1 && result[0].first > result[result.size() - 1].first ) {
+            std::reverse( result.begin(), result.end() );
+        }
+        return result;
+    }
+
     bool isPrime( T i ) const {
-        return factors[i] == 1;
+        return storage.isPrime( i );
     }
 
+    /*
+     * index divided by its largest prime factor (1 for a prime), for every
+     * storage policy; the compact policies decode all the factors to find it
+     */
     int getLowestFactor( std::size_t index ) const {
         if ( index >= size ) throw std::out_of_range("Index out of range");
-        return factors[index];
+        return storage.withoutLargest( index );
     }
 private:
-    std::vector<T> factors;
+    Storage storage;
     std::size_t size;
 };
 
@@ -0,0 +1,52 @@
+#ifndef PE_REGISTRY_H
+#define PE_REGISTRY_H
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Registry of solution() functions for the multi-solution runner.
+ * Built with -DPE_RUNNER -DPE_SOLUTION=NNN, main.h renames the file's
+ * solution() to solutionNNN and registers it here under "NNN" instead of
+ * defining main(), so every solution can be linked into one binary.
+ */
+typedef std::string (*SolutionFunction)();
+
+class SolutionRegistry {
+public:
+    typedef std::pair<std::string, SolutionFunction> Entry;
+
+    static void add( const char* name, SolutionFunction function ) {
+        entries().emplace_back( name, function );
+    }
+
+    /*
+     * Every registered solution, ordered by number
+     */
+    static std::vector<Entry> all() {
+        std::vector<Entry> sorted( entries() );
+        std::sort( sorted.begin(), sorted.end() );
+        return sorted;
+    }
+
+private:
+    static std::vector<Entry>& entries() {
+        static std::vector<Entry> registered;
+        return registered;
+    }
+};
+
+struct SolutionRegistrar {
+    SolutionRegistrar( const char* name, SolutionFunction function ) {
+        SolutionRegistry::add( name, function );
+    }
+};
+
+#define PE_REGISTRY_CONCAT_INNER( a, b ) a##b
+#define PE_REGISTRY_CONCAT( a, b ) PE_REGISTRY_CONCAT_INNER( a, b )
+#define PE_REGISTRY_STRING_INNER( a ) #a
+#define PE_REGISTRY_STRING( a ) PE_REGISTRY_STRING_INNER( a )
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef PE_WIDE_INT_H
+#define PE_WIDE_INT_H
+
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "peCalculation.h"
+
+/*
+ * Fixed width unsigned integer of Words 64-bit limbs, little endian.
+ * Lives entirely on the stack; arithmetic wraps modulo 2^(64 * Words)
+ * like the built-in unsigned types.
+ *
+ * Supports the operators the generic templates (ModularExp, isMrPrime,
+ * integerDivision) need, so UInt128 can stand in for a bigint whenever
+ * products of 64-bit values must not overflow, and UInt256 likewise for
+ * 128-bit values.
+ */
+template<int Words>
+class WideUInt {
+public:
+    std::uint64_t w[Words];
+
+    WideUInt() : w() {}
+
+    template<typename I, typename = typename std::enable_if<std::is_integral<I>::value>::type>
+    WideUInt( I x ) {
+        // negative values sign extend, as a conversion to unsigned would
+        const std::uint64_t fill = x < 0 ? ~0ULL : 0;
+        w[0] = (std::uint64_t) x;
+        for ( int i = 1; i < Words; i++ ) w[i] = fill;
+    }
+
+    WideUInt( unsigned __int128 x ) {
+        for ( int i = 0; i < Words; i++ ) {
+            w[i] = i < 2 ? (std::uint64_t) x : 0;
+            x >>= i < 2 ? 64 : 0;
+        }
+    }
+
+    /*
+     * Widen or truncate from another width
+     */
+    template<int Other>
+    explicit WideUInt( const WideUInt<Other>& other ) {
+        for ( int i = 0; i < Words; i++ ) w[i] = i < Other ? other.w[i] : 0;
+    }
+
+    static WideUInt max() {
+        WideUInt result;
+        for ( int i = 0; i < Words; i++ ) result.w[i] = ~0ULL;
+        return result;
+    }
+
+    std::uint64_t low64() const { return w[0]; }
+
+    /*
+     * Truncating conversion to a built-in integer; bool tests for non-zero
+     */
+    template<typename I, typename = typename std::enable_if<std::is_integral<I>::value>::type>
+    explicit operator I() const {
+        return std::is_same<I, bool>::value ? (I) !isZero() : (I) w[0];
+    }
+
+    bool isZero() const {
+        std::uint64_t any = 0;
+        for ( int i = 0; i < Words; i++ ) any |= w[i];
+        return any == 0;
+    }
+
+    bool fitsIn64() const {
+        for ( int i = 1; i < Words; i++ ) if ( w[i] ) return false;
+        return true;
+    }
+
+    int bitLength() const {
+        for ( int i = Words - 1; i >= 0; i-- ) {
+            if ( w[i] ) return 64 * i + 64 - __builtin_clzll( w[i] );
+        }
+        return 0;
+    }
+
+    bool bit( int i ) const { return ( w[i / 64] >> ( i % 64 ) ) & 1; }
+
+    // comparison
+    friend bool operator==( const WideUInt& a, const WideUInt& b ) {
+        std::uint64_t diff = 0;
+        for ( int i = 0; i < Words; i++ ) diff |= a.w[i] ^ b.w[i];
+        return diff == 0;
+    }
+    friend bool operator!=( const WideUInt& a, const WideUInt& b ) { return !( a == b ); }
+    friend bool operator<( const WideUInt& a, const WideUInt& b ) {
+        for ( int i = Words - 1; i >= 0; i-- ) {
+            if ( a.w[i] != b.w[i] ) return a.w[i] < b.w[i];
+        }
+        return false;
+    }
+    friend bool operator>( const WideUInt& a, const WideUInt& b ) { return b < a; }
+    friend bool operator<=( const WideUInt& a, const WideUInt& b ) { return !( b < a ); }
+    friend bool operator>=( const WideUInt& a, const WideUInt& b ) { return !( a < b ); }
+
+    // addition and subtraction
+    WideUInt& operator+=( const WideUInt& o ) {
+        unsigned char carry = 0;
+        for ( int i = 0; i < Words; i++ ) {
+            unsigned __int128 sum = (unsigned __int128) w[i] + o.w[i] + carry;
+            w[i] = (std::uint64_t) sum;
+            carry = (unsigned char)( sum >> 64 );
+        }
+        return *this;
+    }
+    WideUInt& operator-=( const WideUInt& o ) {
+        unsigned char borrow = 0;
+        for ( int i = 0; i < Words; i++ ) {
+            unsigned __int128 diff = (unsigned __int128) w[i] - o.w[i] - borrow;
+            w[i] = (std::uint64_t) diff;
+            borrow = (unsigned char)( ( diff >> 64 ) & 1 );
+        }
+        return *this;
+    }
+    WideUInt& operator++() { return *this += WideUInt( 1 ); }
+    WideUInt& operator--() { return *this -= WideUInt( 1 ); }
+    WideUInt operator++( int ) { WideUInt old = *this; ++*this; return old; }
+    WideUInt operator--( int ) { WideUInt old = *this; --*this; return old; }
+
+    // multiplication, truncated to Words limbs
+    WideUInt& operator*=( const WideUInt& o ) { return *this = *this * o; }
+    friend WideUInt operator*( const WideUInt& a, const WideUInt& b ) {
+        WideUInt result;
+        for ( int i = 0; i < Words; i++ ) {
+            if ( a.w[i] == 0 ) continue;
+            std::uint64_t carry = 0;
+            for ( int j = 0; i + j < Words; j++ ) {
+                unsigned __int128 t = (unsigned __int128) a.w[i] * b.w[j] + result.w[i + j] + carry;
+                result.w[i + j] = (std::uint64_t) t;
+                carry = (std::uint64_t)( t >> 64 );
+            }
+        }
+        return result;
+    }
+
+    // division
+    WideUInt& operator/=( const WideUInt& o ) { WideUInt r; divide( *this, o, this, &r ); return *this; }
+    WideUInt& operator%=( const WideUInt& o ) { WideUInt q; divide( *this, o, &q, this ); return *this; }
+    friend WideUInt operator/( const WideUInt& a, const WideUInt& b ) { WideUInt q, r; divide( a, b, &q, &r ); return q; }
+    friend WideUInt operator%( const WideUInt& a, const WideUInt& b ) { WideUInt q, r; divide( a, b, &q, &r ); return r; }
+
+    /*
+     * Quotient by a 64-bit divisor, one hardware division per limb
+     */
+    WideUInt divide64( std::uint64_t d, std::uint64_t* remainder ) const {
+        if ( d == 0 ) throw std::domain_error("Division by zero");
+        WideUInt q;
+        std::uint64_t r = 0;
+        for ( int i = Words - 1; i >= 0; i-- ) q.w[i] = divide128by64( r, w[i], d, &r );
+        if ( remainder ) *remainder = r;
+        return q;
+    }
+
+    /*
+     * Long division; 64-bit divisors take the per-limb path, larger ones
+     * shift and subtract over the difference in bit lengths only
+     */
+    static void divide( const WideUInt& n, const WideUInt& d, WideUInt* quotient, WideUInt* remainder ) {
+        if ( d.isZero() ) throw std::domain_error("Division by zero");
+        if ( d.fitsIn64() ) {
+            std::uint64_t r;
+            *quotient = n.divide64( d.w[0], &r );
+            *remainder = WideUInt( r );
+            return;
+        }
+        WideUInt q, r = n;
+        int shift = n.bitLength() - d.bitLength();
+        if ( shift >= 0 ) {
+            WideUInt shifted = d << shift;
+            for ( ; shift >= 0; shift-- ) {
+                if ( r >= shifted ) {
+                    r -= shifted;
+                    q.w[shift / 64] |= 1ULL << ( shift % 64 );
+                }
+                shifted >>= 1;
+            }
+        }
+        *quotient = q;
+        *remainder = r;
+    }
+
+    // bitwise
+    WideUInt& operator&=( const WideUInt& o ) { for ( int i = 0; i < Words; i++ ) w[i] &= o.w[i]; return *this; }
+    WideUInt& operator|=( const WideUInt& o ) { for ( int i = 0; i < Words; i++ ) w[i] |= o.w[i]; return *this; }
+    WideUInt& operator^=( const WideUInt& o ) { for ( int i = 0; i < Words; i++ ) w[i] ^= o.w[i]; return *this; }
+    WideUInt operator~() const { WideUInt r; for ( int i = 0; i < Words; i++ ) r.w[i] = ~w[i]; return r; }
+
+    WideUInt& operator<<=( int s ) {
+        if ( s >= 64 * Words ) return *this = WideUInt();
+        const int limbs = s / 64, bits = s % 64;
+        for ( int i = Words - 1; i >= 0; i-- ) {
+            std::uint64_t v = i - limbs >= 0 ? w[i - limbs] << bits : 0;
+            if ( bits && i - limbs - 1 >= 0 ) v |= w[i - limbs - 1] >> ( 64 - bits );
+            w[i] = v;
+        }
+        return *this;
+    }
+    WideUInt& operator>>=( int s ) {
+        if ( s >= 64 * Words ) return *this = WideUInt();
+        const int limbs = s / 64, bits = s % 64;
+        for ( int i = 0; i < Words; i++ ) {
+            std::uint64_t v = i + limbs < Words ? w[i + limbs] >> bits : 0;
+            if ( bits && i + limbs + 1 < Words ) v |= w[i + limbs + 1] << ( 64 - bits );
+            w[i] = v;
+        }
+        return *this;
+    }
+    // shift amounts given as WideUInt, as the generic templates do (exp >>= V(1))
+    WideUInt& operator<<=( const WideUInt& s ) { return *this <<= shiftAmount( s ); }
+    WideUInt& operator>>=( const WideUInt& s ) { return *this >>= shiftAmount( s ); }
+
+    friend WideUInt operator+( WideUInt a, const WideUInt& b ) { return a += b; }
+    friend WideUInt operator-( WideUInt a, const WideUInt& b ) { return a -= b; }
+    friend WideUInt operator&( WideUInt a, const WideUInt& b ) { return a &= b; }
+    friend WideUInt operator|( WideUInt a, const WideUInt& b ) { return a |= b; }
+    friend WideUInt operator^( WideUInt a, const WideUInt& b ) { return a ^= b; }
+    friend WideUInt operator<<( WideUInt a, int s ) { return a <<= s; }
+    friend WideUInt operator>>( WideUInt a, int s ) { return a >>= s; }
+
+    std::string toString() const {
+        if ( isZero() ) return "0";
+        std::string digits;
+        WideUInt n = *this;
+        while ( !n.isZero() ) {
+            std::uint64_t chunk;
+            n = n.divide64( 10000000000000000000ULL, &chunk );
+            for ( int i = 0; i < 19 && ( chunk || !n.isZero() ); i++ ) {
+                digits.push_back( '0' + chunk % 10 );
+                chunk /= 10;
+            }
+        }
+        return std::string( digits.rbegin(), digits.rend() );
+    }
+
+    friend std::ostream& operator<<( std::ostream& out, const WideUInt& n ) { return out << n.toString(); }
+
+private:
+    static int shiftAmount( const WideUInt& s ) {
+        return s.fitsIn64() && s.w[0] < (std::uint64_t) 64 * Words ? (int) s.w[0] : 64 * Words;
+    }
+
+    /*
+     * (high:low) / d for high < d; the quotient then fits in 64 bits
+     */
+    static std::uint64_t divide128by64( std::uint64_t high, std::uint64_t low, std::uint64_t d, std::uint64_t* r ) {
+#if defined(__x86_64__)
+        std::uint64_t q;
+        __asm__( "divq %4" : "=a"( q ), "=d"( *r ) : "a"( low ), "d"( high ), "rm"( d ) );
+        return q;
+#else
+        unsigned __int128 n = ( (unsigned __int128) high << 64 ) | low;
+        *r = (std::uint64_t)( n % d );
+        return (std::uint64_t)( n / d );
+#endif
+    }
+};
+
+typedef WideUInt<2> UInt128;
+typedef WideUInt<4> UInt256;
+
+/*
+ * Full product of two N-limb values as 2N limbs; never overflows
+ */
+template<int Words>
+WideUInt<2 * Words> multiplyFull( const WideUInt<Words>& a, const WideUInt<Words>& b ) {
+    WideUInt<2 * Words> result;
+    for ( int i = 0; i < Words; i++ ) {
+        std::uint64_t carry = 0;
+        for ( int j = 0; j < Words; j++ ) {
+            unsigned __int128 t = (unsigned __int128) a.w[i] * b.w[j] + result.w[i + j] + carry;
+            result.w[i + j] = (std::uint64_t) t;
+            carry = (std::uint64_t)( t >> 64 );
+        }
+        result.w[i + Words] = carry;
+    }
+    return result;
+}
+
+/*
+ * Overflow-checked multiply, in the style of __builtin_mul_overflow:
+ * stores the truncated product and returns true if it overflowed
+ */
+template<int Words>
+bool mulOverflow( const WideUInt<Words>& a, const WideUInt<Words>& b, WideUInt<Words>* result ) {
+    WideUInt<2 * Words> full = multiplyFull( a, b );
+    bool overflow = false;
+    for ( int i = 0; i < Words; i++ ) {
+        result->w[i] = full.w[i];
+        overflow |= full.w[i + Words] != 0;
+    }
+    return overflow;
+}
+
+/*
+ * a * b mod m without overflow, via the double width product
+ */
+template<int Words>
+WideUInt<Words> mulMod( const WideUInt<Words>& a, const WideUInt<Words>& b, const WideUInt<Words>& m ) {
+    return WideUInt<Words>( multiplyFull( a, b ) % WideUInt<2 * Words>( m ) );
+}
+
+/*
+ * integerDivision for wide integers; uses the limb-wise division
+ * rather than the generic bit-serial loop
+ */
+template<int Words>
+void integerDivision( const WideUInt<Words>& numerator, const WideUInt<Words>& denominator,
+                      WideUInt<Words>* quotient, WideUInt<Words>* remainder ) {
+    WideUInt<Words>::divide( numerator, denominator, quotient, remainder );
+}
+
+#endif
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "peInstrument.h"
+#include "pePrimes.h"
+#include "peRegistry.h"
+
+/*
+ * Runs every solution linked in through the registry in one process:
+ *   runner [--list] [--jobs N] [--runs N] [--no-share] [--answers FILE] [FILTER...]
+ * A FILTER is a solution number (146) or an inclusive range (100-199);
+ * with none, everything runs. --jobs runs that many solutions at once.
+ * --runs times each solution N times and reports the min and median.
+ * Prime lists are shared between solutions (SharedPrimeList) unless
+ * --no-share is given. --answers checks against "NNN answer" lines.
+ * Exit status is 1 if any answer is wrong or a solution throws.
+ */
+
+struct RunResult {
+    std::string answer;
+    std::string error;
+    std::vector<double> times;
+};
+
+bool matchesFilter( const std::string& name, const std::vector<std::string>& filters ) {
+    if ( filters.empty() ) return true;
+    int number = std::atoi( name.c_str() );
+    for ( const std::string& filter : filters ) {
+        std::size_t dash = filter.find( '-' );
+        if ( dash == std::string::npos ) {
+            if ( std::atoi( filter.c_str() ) == number ) return true;
+        } else {
+            int low = std::atoi( filter.substr( 0, dash ).c_str() );
+            int high = std::atoi( filter.substr( dash + 1 ).c_str() );
+            if ( low <= number && number <= high ) return true;
+        }
+    }
+    return false;
+}
+
+std::map<std::string, std::string> readAnswers( const char* path ) {
+    std::map<std::string, std::string> answers;
+    std::ifstream file( path );
+    if ( !file ) std::cerr << "Cannot read answers from " << path << std::endl;
+    std::string name, answer;
+    while ( file >> name >> answer ) answers[name] = answer;
+    return answers;
+}
+
+RunResult runSolution( const SolutionRegistry::Entry& entry, int runs ) {
+    RunResult result;
+    try {
+        for ( int i = 0; i < runs; i++ ) {
+            auto start = std::chrono::steady_clock::now();
+            {
+                PE_PHASE( entry.first.c_str() );
+                result.answer = entry.second();
+            }
+            auto end = std::chrono::steady_clock::now();
+            result.times.push_back( std::chrono::duration<double, std::milli>( end - start ).count() );
+        }
+    } catch ( const std::exception& e ) {
+        result.error = e.what();
+    }
+    std::sort( result.times.begin(), result.times.end() );
+    return result;
+}
+
+int main( int argc, char** argv ) {
+    bool list = false, share = true;
+    int jobs = 1, runs = 1;
+    std::vector<std::string> filters;
+    std::map<std::string, std::string> answers;
+    for ( int i = 1; i < argc; i++ ) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ( arg == "--list" ) {
+            list = true;
+        } else if ( arg == "--jobs" && hasValue ) {
+            jobs = std::max( 1, std::atoi( argv[++i] ) );
+        } else if ( arg == "--runs" && hasValue ) {
+            runs = std::max( 1, std::atoi( argv[++i] ) );
+        } else if ( arg == "--no-share" ) {
+            share = false;
+        } else if ( arg == "--answers" && hasValue ) {
+            answers = readAnswers( argv[++i] );
+        } else if ( !arg.empty() && arg[0] != '-' ) {
+            filters.push_back( arg );
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--list] [--jobs N] [--runs N] [--no-share] [--answers FILE] [FILTER...]" << std::endl;
+            return 2;
+        }
+    }
+
+    std::vector<SolutionRegistry::Entry> selected;
+    for ( const auto& entry : SolutionRegistry::all() ) {
+        if ( matchesFilter( entry.first, filters ) ) selected.push_back( entry );
+    }
+    if ( list ) {
+        for ( const auto& entry : selected ) std::cout << entry.first << std::endl;
+        return 0;
+    }
+    SharedPrimeList::enable( share );
+
+    // solutions are claimed in order by whichever worker is free
+    std::vector<RunResult> results( selected.size() );
+    std::atomic<std::size_t> next( 0 );
+    auto worker = [&]() {
+        std::size_t i;
+        while ( ( i = next++ ) < selected.size() ) results[i] = runSolution( selected[i], runs );
+    };
+    auto wallStart = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for ( int t = 1; t < jobs; t++ ) pool.emplace_back( worker );
+    worker();
+    for ( auto& thread : pool ) thread.join();
+    double wall = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - wallStart ).count();
+
+    bool allCorrect = true;
+    double medianTotal = 0;
+    std::cout << std::left << std::setw( 10 ) << "Solution" << std::setw( 22 ) << "Answer" << std::right
+              << std::setw( 12 ) << "min ms" << std::setw( 12 ) << "median ms" << "  Check" << std::endl;
+    std::cout << std::fixed << std::setprecision( 3 );
+    for ( std::size_t i = 0; i < selected.size(); i++ ) {
+        const RunResult& r = results[i];
+        std::cout << std::left << std::setw( 10 ) << selected[i].first;
+        if ( !r.error.empty() ) {
+            std::cout << "error: " << r.error << std::endl;
+            allCorrect = false;
+            continue;
+        }
+        std::size_t n = r.times.size();
+        double median = n % 2 ? r.times[n / 2] : ( r.times[n / 2 - 1] + r.times[n / 2] ) / 2;
+        medianTotal += median;
+        std::cout << std::setw( 22 ) << r.answer << std::right << std::setw( 12 ) << r.times.front()
+                  << std::setw( 12 ) << median << "  ";
+        auto expected = answers.find( selected[i].first );
+        if ( expected == answers.end() ) {
+            std::cout << "-";
+        } else if ( expected->second == r.answer ) {
+            std::cout << "ok";
+        } else {
+            std::cout << "WRONG (expected " << expected->second << ")";
+            allCorrect = false;
+        }
+        std::cout << std::endl;
+    }
+    std::cout << selected.size() << " solutions, " << jobs << " at a time; sum of medians " << medianTotal
+              << " ms, wall time " << wall << " ms" << std::endl;
+    std::cout << std::defaultfloat;
+    PE_REPORT( std::cout );
+
+    return allCorrect ? 0 : 1;
+}
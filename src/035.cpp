@@ -13,7 +13,7 @@ std::string solution() {
     int limit = 1000000;
 
     int cycleCount = 0;
-    std::vector<bool> primes = generatePrimalityTable( limit );
+    PrimalityBitset primes( limit );
     std::vector<bool> checked( limit, false );
     for ( int p = 2; p < limit; p++ ) {
         if ( !primes[p] || checked[p] ) continue;
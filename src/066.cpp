@@ -3,6 +3,7 @@
 #include <stdexcept>
 #include <gmpxx.h>
 #include "main.h"
+#include "peParallel.h"
 
 /*
  * http://www.isibang.ac.in/~sury/chakravala.pdf
@@ -42,17 +43,12 @@ chak_method(int n) {
 
 std::string solution() {
     int limit = 1000;
-    bigint_t max_x = 0;
-    int max_i = 0;
-    for (int i = 2; i < limit; i++) {
+    // (x, D) of the largest minimal solution; ties keep the smaller D
+    typedef std::pair<bigint_t, int> best_t;
+    best_t best = parallelReduce(2, limit, best_t(0, 0), [](std::int64_t i) {
         int rt = (int) sqrt(i);
-        if (rt * rt == i) continue;
-        std::tuple<bigint_t, bigint_t> res = chak_method(i);
-        bigint_t x  = std::get<0>(res);
-        if (x > max_x) {
-            max_x = x;
-            max_i = i;
-        }
-    }
-    return std::to_string(max_i);
+        if (rt * rt == i) return best_t(0, 0);
+        return best_t(std::get<0>(chak_method(i)), (int) i);
+    }, [](const best_t& a, const best_t& b) { return b.first > a.first ? b : a; });
+    return std::to_string(best.second);
 }
@@ -21,9 +21,9 @@ bool Permutations( int x, int y ) {
 std::string solution() {
     int limit = 10000000;
     std::vector< std::pair<int, int> > results;
-    PrimeFactorsList<int> primeFactors( limit );
-    for ( int i = 1; i < limit; i++ ) {
-        int totient = EulerTotient( primeFactors[i] );
+    PrimeFactorsList<int, SmallestFactorStorage<std::uint16_t> > primeFactors( limit );
+    for ( int i = 2; i < limit; i++ ) {
+        int totient = EulerTotient( primeFactors.factorize( i ) );
         if ( Permutations( totient, i ) ) {
             results.push_back( std::pair<int, int>(i, totient) );
         }
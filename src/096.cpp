@@ -1,9 +1,9 @@
-#include <chrono>
 #include <cstring>
 #include <sstream>
 #include <fstream>
 #include <vector>
 #include "main.h"
+#include "peInstrument.h"
 
 #define LENGTH 9
 #define SIZE 81
@@ -278,31 +278,27 @@ parseGrids( const char* path ) {
 }
 
 std::string solution() {
-    calcUnitArr( UNIT_SET );
+    std::vector< std::vector<int> > grids;
+    {
+        PE_PHASE( "setup" );
+        calcUnitArr( UNIT_SET );
 
-    for ( int i = 0; i < LENGTH; i++ ) {
-        for ( int j = 0; j < LENGTH; j++ ) {
-            calcPeers(i, j, &PEER_SET[PEERS * (i + j * LENGTH)]);
+        for ( int i = 0; i < LENGTH; i++ ) {
+            for ( int j = 0; j < LENGTH; j++ ) {
+                calcPeers(i, j, &PEER_SET[PEERS * (i + j * LENGTH)]);
+            }
         }
+        grids = parseGrids( INPUT_FILE );
     }
-    std::vector< std::vector<int> > grids = parseGrids( INPUT_FILE );
 
     Grid out;
     int sum = 0;
     for ( auto it = grids.begin(); it != grids.end(); ++it ) {
-        auto gridTime = std::chrono::steady_clock::now();
+        PE_PHASE( "solve grid" );
         Grid g( it->data() );
         if ( !solve( g, &out ) ) {
             std::cout << "FAILED" << std::endl;
             std::cout << g.str() << std::endl;
-        } else {
-            auto gridRunTime = std::chrono::steady_clock::now() - gridTime;
-            double timeTaken = std::chrono::duration<double, std::milli> (gridRunTime).count();
-            if ( timeTaken > 100. ) {
-                std::cout << "This took " << timeTaken << "ms" << std::endl;
-                std::cout << g.str() << std::endl;
-                std::cout << out.str() << std::endl;
-            }
         }
         int n = out.cells[0].value * 100 + out.cells[1].value * 10 + out.cells[2].value;
         sum += n;
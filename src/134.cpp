@@ -1,4 +1,5 @@
 #include <stdexcept>
+#include <vector>
 #include "main.h"
 #include "peCalculation.h"
 #include "pePrimes.h"
@@ -28,17 +29,24 @@ int power_of_ten(int target) {
 }
 
 std::string solution() {
+    // p2 runs one past LIMIT, so stream the primes rather than guess a sieve size
+    std::vector<int> p1s, p2s, tens;
+    PrimeStream primes(5);
+    for (int p1 = primes.next(), p2 = primes.next(); p1 <= LIMIT; p1 = p2, p2 = primes.next()) {
+        p1s.push_back(p1);
+        p2s.push_back(p2);
+        tens.push_back(power_of_ten(p1));
+    }
+
+    // every pair has its own modulus; invert them all in one interleaved pass
+    std::vector<int> invs(tens.size());
+    multiModularInverse(tens.data(), p2s.data(), tens.size(), invs.data());
+
     long long int sum = 0;
-    auto primes = generatePrimeList<int>(LIMIT + 100);
-    for (auto p1_it = primes.begin() + 2, p2_it = primes.begin() + 3;
-            p2_it != primes.end() && *p1_it <= LIMIT;
-            ++p1_it, ++p2_it) {
-        auto p1 = *p1_it, p2 = *p2_it;
-        int ten_d = power_of_ten(p1);
-        auto inv = ModularInv(ten_d, p2);
-        if (inv == 0) throw std::domain_error("No inverse somehow!");
-        long long int k = ((long long int) inv * (long long int) (p2 - p1) % p2);
-        sum += k * ten_d + p1;
+    for (size_t i = 0; i < invs.size(); i++) {
+        if (invs[i] == 0) throw std::domain_error("No inverse somehow!");
+        long long int k = ((long long int) invs[i] * (long long int) (p2s[i] - p1s[i]) % p2s[i]);
+        sum += k * tens[i] + p1s[i];
     }
     return std::to_string(sum);
 }
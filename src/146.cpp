@@ -1,9 +1,32 @@
-#include <boost/multiprecision/cpp_int.hpp>
 #include "main.h"
+#include "peParallel.h"
 #include "pePrimes.h"
+#include "peInstrument.h"
 
 typedef unsigned long long int uLongInt;
-typedef boost::multiprecision::cpp_int bigint;
+
+static constexpr int ADDITIONS[] = { 1, 3, 7, 9, 13, 27 };
+static constexpr std::size_t FILTER_PRIMES = 18; // the primes below 64
+static constexpr auto filterPrimes = smallPrimes<FILTER_PRIMES>();
+
+/*
+ * Bit r of mask i is set when filterPrimes[i] divides r^2 + d for some
+ * d in ADDITIONS; baked in at compile time so the filter for the
+ * smallest primes is a table lookup rather than six multiplications
+ */
+constexpr std::array<std::uint64_t, FILTER_PRIMES> residueMasks() {
+    std::array<std::uint64_t, FILTER_PRIMES> masks{};
+    for ( std::size_t i = 0; i < FILTER_PRIMES; i++ ) {
+        const std::uint64_t p = filterPrimes[i];
+        for ( std::uint64_t r = 0; r < p; r++ ) {
+            for ( int d : ADDITIONS ) {
+                if ( ( r * r + d ) % p == 0 ) masks[i] |= 1ULL << r;
+            }
+        }
+    }
+    return masks;
+}
+static constexpr auto filterMasks = residueMasks();
 
 /*
  * Sum of n for n < 150 million and
@@ -21,48 +44,82 @@ typedef boost::multiprecision::cpp_int bigint;
  * checking for this relationship against
  * various primes (say p < 1 million)
  *
- * Runtime ~3sec 3.4GHz i5
+ * The primes below 64 are checked against residue masks built at compile time.
+ * Blocks of candidates are filtered on all cores (peParallel.h).
+ *
+ * Runtime ~0.6sec
  */
 
 std::string solution() {
     int limit = 150000000;
     int initialPrimeCount = 1000000;
-    std::vector<int> additions { 1, 3, 7, 9, 13, 27 };
+    std::vector<int> additions( std::begin( ADDITIONS ), std::end( ADDITIONS ) );
     std::vector<int> nonAdditions { 19, 21 };
-    std::vector<int> primes = generatePrimeList<int>( initialPrimeCount );
+    std::vector<int> primes;
     std::vector<int> candidatePrimes;
     int sum = 0;
+    {
+        PE_PHASE( "sieve" );
+        primes = SharedPrimeList::get<int>( initialPrimeCount );
+    }
 
-    for ( int n = 0; n < limit; n += 10 ) {
-        if ( n % 3 == 0 || n % 7 == 0 ) continue;
-        for ( auto it = primes.begin(); it != primes.end(); ++it ) {
-            if ( *it > n ) break;
-            int p = *it;
-            long long int r = n % p; //multiplication may overflow int
-            for ( auto jt = additions.begin(); jt != additions.end(); ++jt ) {
-                if ( ( r * r + *jt ) % p == 0 ) goto CANDIDATE_FAILURE;
+    {
+        PE_PHASE( "candidate filter" );
+        // blocks of n are filtered in parallel and their candidates joined in order
+        const int blockSize = 1000000;
+        std::vector<std::vector<int>> blockCandidates( ( limit + blockSize - 1 ) / blockSize );
+        parallelFor( 0, blockCandidates.size(), [&]( std::int64_t block ) {
+            int end = std::min<long long>( limit, ( block + 1 ) * (long long) blockSize );
+            for ( int n = block * blockSize; n < end; n += 10 ) {
+                if ( n % 3 == 0 || n % 7 == 0 ) continue;
+                for ( std::size_t i = 0; i < FILTER_PRIMES && (int) filterPrimes[i] <= n; i++ ) {
+                    if ( ( filterMasks[i] >> ( n % filterPrimes[i] ) ) & 1 ) goto CANDIDATE_FAILURE;
+                }
+                for ( auto it = primes.begin() + FILTER_PRIMES; it != primes.end(); ++it ) {
+                    if ( *it > n ) break;
+                    int p = *it;
+                    long long int r = n % p; //multiplication may overflow int
+                    for ( auto jt = additions.begin(); jt != additions.end(); ++jt ) {
+                        if ( ( r * r + *jt ) % p == 0 ) goto CANDIDATE_FAILURE;
+                    }
+                }
+                blockCandidates[block].push_back( n );
+            CANDIDATE_FAILURE:;
             }
+        }, 1 );
+        for ( const auto& candidates : blockCandidates ) {
+            candidatePrimes.insert( candidatePrimes.end(), candidates.begin(), candidates.end() );
         }
-        candidatePrimes.push_back( n );
-    CANDIDATE_FAILURE:;
+        PE_ELEMENTS( limit / 10 );
+        PE_COUNT( "candidates", candidatePrimes.size() );
     }
 
-    for ( auto it = candidatePrimes.begin(); it != candidatePrimes.end(); ++it ) {
-        uLongInt n = *it;
-        for ( auto jt = additions.begin(); jt != additions.end(); ++jt ) {
-            uLongInt r = n * n + *jt;
-            //if ( !isPrime( r ) ) goto CHECK_FAILURE;
-            bool isPrime = isMrPrime<bigint, uLongInt>( bigint(r) );
-            if ( !isPrime ) goto CHECK_FAILURE;
+    // test every n^2 + d for all candidates in one batch;
+    // value k of candidate i is at index i * offsets.size() + k
+    std::vector<int> offsets( additions );
+    offsets.insert( offsets.end(), nonAdditions.begin(), nonAdditions.end() );
+    std::vector<std::uint64_t> values;
+    std::vector<std::uint64_t> primeMask;
+    {
+        PE_PHASE( "Miller-Rabin" );
+        for ( auto it = candidatePrimes.begin(); it != candidatePrimes.end(); ++it ) {
+            uLongInt n = *it;
+            for ( auto jt = offsets.begin(); jt != offsets.end(); ++jt ) values.push_back( n * n + *jt );
         }
-        for ( auto jt = nonAdditions.begin(); jt != nonAdditions.end(); ++jt ) {
-            uLongInt r = n * n + *jt;
-            //if ( isPrime( r ) ) goto CHECK_FAILURE;
-            bool isPrime = isMrPrime<bigint, uLongInt>( bigint(r) );
-            if ( isPrime ) goto CHECK_FAILURE;
+        primeMask.resize( ( values.size() + 63 ) / 64 );
+        isMrPrimeBatch( values.data(), values.size(), primeMask.data() );
+        PE_ELEMENTS( values.size() );
+        PE_COUNT( "Miller-Rabin values", values.size() );
+    }
+
+    for ( std::size_t i = 0; i < candidatePrimes.size(); i++ ) {
+        bool valid = true;
+        for ( std::size_t k = 0; k < offsets.size(); k++ ) {
+            std::size_t index = i * offsets.size() + k;
+            bool isPrime = ( primeMask[index / 64] >> ( index % 64 ) ) & 1;
+            valid &= isPrime == ( k < additions.size() );
         }
-        sum += n;
-    CHECK_FAILURE:;
+        if ( valid ) sum += candidatePrimes[i];
     }
 
     return std::to_string(sum);
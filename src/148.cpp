@@ -1,4 +1,5 @@
 #include "main.h"
+#include "peCombinations.h"
 
 /*
  * Problem 148
@@ -24,34 +25,17 @@
  * So, for each row n, we can write n as a base p number
  * and take the product of each (digit + 1).
  *
- * Runtime ~30 seconds (Visual Studio 2013)
+ * Summing that row by row took ~30 seconds. Instead, exploit the recursive
+ * nature of the triangle (Pascal's Triangle mod p is very much like
+ * Sierpinksi's triangle): the first p^k rows hold (p(p+1)/2)^k such entries,
+ * so the total follows from the base p digits of the row count
+ * (pascalNonMultiples in peCombinations.h).
  *
- * Could improve by exploiting recursive nature of triangle
- * (Pascal's Triangle mod p is very much like Sierpinksi's triangle)
+ * Runtime < 1 microsecond
  */
 
-int* getRepresentation( int n, int base, int* buffer ) {
-    do {
-        *(buffer++) = n % base;
-    } while ( n /= base );
-    return buffer;
-}
-
 std::string solution() {
     int prime = 7;
-    int limit = 1000000000;
-    int buffer[11];
-    long long int sum = 0;
-
-    for ( int n = 0; n < limit; n++ ) {
-        long long int rowSum = 1;
-        int* end = getRepresentation( n, prime, buffer );
-        for ( int* ptr = &buffer[0]; ptr != end; ++ptr ) {
-            rowSum *= (long long int)( *ptr + 1 );
-        }
-
-        sum += rowSum;
-    }
-
-    return std::to_string(sum);
+    long long int limit = 1000000000;
+    return std::to_string( pascalNonMultiples( limit, prime ) );
 }
@@ -6,6 +6,7 @@
 #include <unordered_set>
 #include <set>
 #include "main.h"
+#include "peInstrument.h"
 
 const int C_LIMIT = 50000;
 
@@ -266,7 +267,8 @@ long long int combined_area(std::vector<cuboid> cuboids) {
             area += length_y * (std::get<0>(*it2) - std::get<0>(point_x));
         }
         sum += area;
-        if (z_level % 500 == 0) std::cout << "At level: " << z_level << ", Current volume: " << sum << std::endl;
+        PE_COUNT("sweep events", filtered.size());
+        PE_ELEMENTS(filtered.size());
     }
     return sum;
 }
@@ -303,9 +305,14 @@ std::vector<cuboid> create_cuboids(const std::vector<int>& lfg) {
 }
 
 std::string solution() {
-    auto lfg = create_lfg(C_LIMIT * 6);
-    std::vector<cuboid> cuboids = create_cuboids(lfg);
+    std::vector<cuboid> cuboids;
+    {
+        PE_PHASE("generate cuboids");
+        auto lfg = create_lfg(C_LIMIT * 6);
+        cuboids = create_cuboids(lfg);
+    }
 
+    PE_PHASE("combined volume");
     long long int area = combined_area(cuboids);
     return std::to_string(area);
 }
@@ -14,7 +14,7 @@ std::string solution() {
     int exhaustiveLimit = 3000000; //don't calculate totient for all non-prime i, only below this limit
     std::vector<int> chainLengths( limit, 0 );
     long long int sum = 0;
-    PrimeFactorsList<int> primeFactors( limit );
+    PrimeFactorsList<int, SmallestFactorStorage<std::uint16_t> > primeFactors( limit );
     for ( int i = 5; i < limit; i++ ) {
         if ( i > exhaustiveLimit && !primeFactors.isPrime(i) ) continue;
         int chainLength = 0;
@@ -26,7 +26,7 @@ std::string solution() {
                 x = 1;
                 goto CACHE_HIT;
             }
-            x = EulerTotient( primeFactors[x] );
+            x = EulerTotient( primeFactors.factorize( x ) );
         }
 CACHE_HIT:
         chainLengths[i] = chainLength;
@@ -69,7 +69,7 @@ std::string solution() {
  * The brute force solution...
  */
 std::string solution_slow() {
-    PrimeFactorsList<int> factors(1000000000);
+    PrimeFactorsList<int, SmallestFactorStorage<std::uint16_t> > factors(1000000000);
     std::cout << "HERE" << std::endl;
     double resiliance = 1;
     int d = 1;
@@ -1,11 +1,10 @@
 #include <algorithm>
 #include <vector>
-#include <boost/multiprecision/cpp_int.hpp>
 #include "pePrimes.h"
+#include "peWideInt.h"
 #include "main.h"
 
 typedef long long int int64;
-typedef boost::multiprecision::cpp_int bigint;
 
 static const int64 LIMIT = 500000000000ll;
 static const int64 LIMIT_SCALED = LIMIT / std::sqrt(3);
@@ -58,17 +57,17 @@ std::vector<int64> calc_generators(std::vector<int64> &primes_1) {
     // get generators for exponents 2, 4, 4
     // we're going to look at "sqrt(g)" instead of "g" because our exponents are all even
     for (auto it = primes_1.begin(); it < primes_1.end(); ++it) {
-        bigint p1 = *it;
+        UInt128 p1 = *it;
         for (auto jt = primes_1.begin(); jt < primes_1.end(); ++jt) {
             if (jt == it) continue;
-            bigint p2 = *jt * *jt;
+            UInt128 p2 = *jt * *jt;
             if (p2 > LIMIT_SCALED || p1 * p2 > LIMIT_SCALED) {
                 break;
             }
             for (auto kt = jt + 1; kt < primes_1.end(); ++kt) {
                 if (kt == it) continue;
-                bigint p3 = *kt * *kt;
-                bigint p = p1 * p2 * p3;
+                UInt128 p3 = *kt * *kt;
+                UInt128 p = p1 * p2 * p3;
                 if (p > LIMIT_SCALED) {
                     break;
                 };
@@ -78,30 +77,30 @@ std::vector<int64> calc_generators(std::vector<int64> &primes_1) {
     }
 
     // get generators for exponents 14 and 4
-    for (bigint p1 : primes_1) {
-        bigint s1 = p1 * p1;
+    for (UInt128 p1 : primes_1) {
+        UInt128 s1 = p1 * p1;
         if (s1 > LIMIT_SCALED) break;
-        for (bigint p2 : primes_1) {
+        for (UInt128 p2 : primes_1) {
             if (p1 == p2) continue;
-            bigint s2 = p2;
+            UInt128 s2 = p2;
             for (int i = 0; i < 6; i++) {
                 s2 *= p2;
             }
-            bigint p = s1 * s2;
+            UInt128 p = s1 * s2;
             if (p > LIMIT_SCALED) break;
             generators.push_back((int64) p);
         }
     }
 
     // get generators for exponents 24, 2
-    for (bigint p1 : primes_1) {
-        bigint s1 = p1 * p1;
+    for (UInt128 p1 : primes_1) {
+        UInt128 s1 = p1 * p1;
         s1 *= s1;
         s1 = s1 * s1 * s1;
         if (s1 > LIMIT_SCALED) break;
-        for (bigint p2 : primes_1) {
+        for (UInt128 p2 : primes_1) {
             if (p1 == p2) continue;
-            bigint p = s1 * p2;
+            UInt128 p = s1 * p2;
             if (p > LIMIT_SCALED) break;
             generators.push_back((int64) p);
         }
@@ -135,7 +134,7 @@ std::vector<int64> products_of_primes_2_modulo_3(int64 limit, std::vector<int64>
 }
 
 std::string solution() {
-    std::vector<int64> primes = generatePrimeList<int64>(100000000);
+    std::vector<int64> primes = SharedPrimeList::get<int64>(100000000);
     std::vector<int64> primes_1;
     for (int64 p : primes) if (p % 3 == 1) primes_1.push_back(p);
 
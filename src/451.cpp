@@ -1,4 +1,3 @@
-#include <algorithm>
 #include "main.h"
 #include "pePrimes.h"
 
@@ -15,27 +14,27 @@
  * than the previously calculated value for that m, store the new value for m
  * in the lookup table (looking up on "n" - the test divisor)
  *
- * Runtime ~ 110 seconds
+ * Divisors are generated straight from the grouped factorisations,
+ * dropping any above the limit as they appear.
  *
- * Still a way off that < 60 second mark
+ * Runtime ~ 24 seconds
  */
 
 std::string solution() {
 
     int limit = 20000000;
     std::vector<long long int> records( limit + 1, 1 );
-    PrimeFactorsList<long long int> factorList( limit + 1 );
+    PrimeFactorsList<long long int, SmallestFactorStorage<std::uint16_t> > factorList( limit + 1 );
 
+    std::vector<long long int> divisors;
     for ( int m = 2; m < limit - 1; m++ ) {
-        std::vector<long long int> factorsL = factorList[m - 1];
-        std::vector<long long int> factorsH = factorList[m + 1];
-        std::vector<long long int> factorsC( factorsL );
-        factorsC.insert( factorsC.end(), factorsH.begin(), factorsH.end() );
-        std::sort( factorsC.begin(), factorsC.end() );
-
-        std::vector<long long int> divisors = calculateAllDivisors( factorsC );
-        for ( auto it = divisors.rbegin(); it != divisors.rend(); ++it ) {
-            if ( m < (*it - 1) && *it <= limit && records[*it] < m ) records[*it] = m;
+        PrimeFactorization<long long int> factors =
+            multiplyFactorizations( factorList.factorize( m - 1 ), factorList.factorize( m + 1 ) );
+
+        // only divisors n with m + 1 < n <= limit are of interest
+        generateDivisors( factors, &divisors, (long long int) m + 2, (long long int) limit );
+        for ( long long int n : divisors ) {
+            if ( records[n] < m ) records[n] = m;
         }
     }
 
@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "main.h"
+#include "peCalculation.h"
 #include "pePrimes.h"
 
 /**
@@ -38,9 +39,7 @@ std::vector<int> generate_fd_primes(int base, int limit) {
 }
 
 std::string solution() {
-    // the 500500th prime is under 8,000,000 so sieve up to there
-    std::vector<int> primes = generatePrimeList<int>(8000000);
-    primes = std::vector<int>(primes.begin(), primes.begin() + 500500);
+    std::vector<int> primes = firstNPrimes<int>(500500);
 
     std::vector<int> fd_primes;
     for (int p : primes) {
@@ -53,12 +52,10 @@ std::string solution() {
     // compiler saves us.
     fd_primes = std::vector<int>(fd_primes.begin(), fd_primes.begin() + 500500);
 
-    int mod = 500500507;
-    long long result = 1;
+    ModInt<500500507> result = 1;
     for (int p : fd_primes) {
         result *= p;
-        result %= mod;
     }
 
-    return std::to_string(result);
+    return std::to_string(result.value());
 }
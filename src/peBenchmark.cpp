@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "peCalculation.h"
+#include "peCombinations.h"
+#include "pePermutations.h"
+#include "pePrimes.h"
+
+/*
+ * Microbenchmarks for the shared headers across input sizes.
+ * Prints CSV: primitive, size, elements, ns per element, bytes per element.
+ * "size" is the parameter being scaled (sieve bound, operand magnitude,
+ * permutation length...); "elements" is what the time is divided by.
+ * Bytes per element is the footprint of the result the primitive builds
+ * (0 for pure arithmetic).
+ *
+ *   ./bin/peBenchmark [--max-exponent E] [FILTER]
+ * Table and enumeration sizes go up to 10^E (default 7); operand
+ * magnitudes always span 10^3 to 10^18. FILTER runs only primitives whose
+ * name contains it.
+ */
+
+typedef unsigned long long int uLongInt;
+
+static volatile uLongInt sink; // keeps results observable
+
+static int maxExponent = 7;
+static std::string filter;
+
+/*
+ * Best of several runs of f, in ns; runs until at least 3 runs and 20 ms
+ */
+template<typename F>
+double bestNs( F f ) {
+    double best = 1e300, total = 0;
+    for ( int runs = 0; runs < 3 || total < 20e6; runs++ ) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        double ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+        best = std::min( best, ns );
+        total += ns;
+        if ( runs >= 1000 ) break;
+    }
+    return best;
+}
+
+void row( const char* primitive, uLongInt size, uLongInt elements, double ns, double bytes ) {
+    std::cout << primitive << "," << size << "," << elements << "," << ns / elements << "," << bytes / elements << std::endl;
+}
+
+bool selected( const char* primitive ) {
+    return filter.empty() || std::string( primitive ).find( filter ) != std::string::npos;
+}
+
+/*
+ * Powers of ten from 10^low to 10^high
+ */
+std::vector<uLongInt> magnitudes( int low, int high ) {
+    std::vector<uLongInt> result;
+    uLongInt n = 1;
+    for ( int e = 0; e <= high; e++, n *= 10 ) {
+        if ( e >= low ) result.push_back( n );
+    }
+    return result;
+}
+
+/*
+ * Workload sizes: as magnitudes, but no larger than 10^maxExponent
+ */
+std::vector<uLongInt> sizes( int low, int high ) {
+    return magnitudes( low, std::min( high, maxExponent ) );
+}
+
+uLongInt nextRandom( uLongInt& state ) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+void sieves() {
+    if ( selected( "generatePrimalityTable" ) ) {
+        for ( uLongInt n : sizes( 3, 9 ) ) {
+            std::vector<bool> table;
+            double ns = bestNs( [&]() { table = generatePrimalityTable<int>( (int) n ); } );
+            row( "generatePrimalityTable", n, n, ns, table.capacity() / 8.0 );
+        }
+    }
+    if ( selected( "generatePrimeList" ) ) {
+        for ( uLongInt n : sizes( 3, 9 ) ) {
+            std::vector<int> primes;
+            double ns = bestNs( [&]() { primes = generatePrimeList<int>( (int) n ); } );
+            row( "generatePrimeList", n, n, ns, (double) primes.capacity() * sizeof( int ) );
+        }
+    }
+    if ( selected( "PrimalityBitset" ) ) {
+        for ( uLongInt n : sizes( 3, 9 ) ) {
+            std::size_t bytes = 0;
+            double ns = bestNs( [&]() { PrimalityBitset table( n ); bytes = ( n + 29 ) / 30; sink = table.size(); } );
+            row( "PrimalityBitset", n, n, ns, (double) bytes );
+        }
+    }
+}
+
+void factorTables() {
+    for ( uLongInt n : sizes( 3, 8 ) ) {
+        if ( selected( "PrimeFactorsList construction" ) ) {
+            double ns = bestNs( [&]() { PrimeFactorsList<int> table( n ); sink = table.getLowestFactor( n - 1 ); } );
+            row( "PrimeFactorsList construction", n, n, ns, (double) n * sizeof( int ) );
+        }
+        if ( selected( "PrimeFactorsList<SmallestFactorStorage> construction" ) ) {
+            double ns = bestNs( [&]() {
+                PrimeFactorsList<int, SmallestFactorStorage<std::uint16_t>> table( n );
+                sink = table.getLowestFactor( n - 1 );
+            } );
+            row( "PrimeFactorsList<SmallestFactorStorage> construction", n, n, ns, (double) n * sizeof( std::uint16_t ) );
+        }
+        if ( selected( "PrimeFactorsList forEachFactor" ) ) {
+            PrimeFactorsList<int> table( n );
+            double ns = bestNs( [&]() {
+                uLongInt sum = 0;
+                for ( uLongInt k = 2; k < n; k++ ) table.forEachFactor( k, [&sum]( int p ) { sum += p; } );
+                sink = sum;
+            } );
+            row( "PrimeFactorsList forEachFactor", n, n, ns, 0 );
+        }
+    }
+}
+
+void primality() {
+    const int count = 10000;
+    // operands of magnitude ~size, odd, so trial division rejects fewer
+    for ( uLongInt magnitude : magnitudes( 3, 18 ) ) {
+        std::vector<std::uint64_t> candidates( count );
+        uLongInt state = 88172645463325252ULL;
+        for ( auto& c : candidates ) c = ( magnitude + nextRandom( state ) % ( 9 * magnitude ) ) | 1;
+        if ( selected( "isMrPrime" ) ) {
+            double ns = bestNs( [&]() {
+                uLongInt primes = 0;
+                for ( std::uint64_t c : candidates ) primes += isMrPrime<std::uint64_t>( c );
+                sink = primes;
+            } );
+            row( "isMrPrime", magnitude, count, ns, 0 );
+        }
+        if ( selected( "isMrPrimeBatch" ) ) {
+            std::vector<std::uint64_t> mask( ( count + 63 ) / 64 );
+            double ns = bestNs( [&]() { isMrPrimeBatch( candidates.data(), count, mask.data() ); sink = mask[0]; } );
+            row( "isMrPrimeBatch", magnitude, count, ns, 0 );
+        }
+        if ( selected( "factorize" ) && magnitude >= 1000 ) {
+            double ns = bestNs( [&]() {
+                uLongInt factors = 0;
+                for ( int i = 0; i < count / 10; i++ ) factors += factorize( candidates[i] ).size();
+                sink = factors;
+            } );
+            row( "factorize", magnitude, count / 10, ns, 0 );
+        }
+    }
+}
+
+void modular() {
+    const int count = 10000;
+    for ( uLongInt magnitude : magnitudes( 3, 18 ) ) {
+        uLongInt state = 1442695040888963407ULL;
+        std::vector<long long> values( count ), mods( count );
+        for ( int i = 0; i < count; i++ ) {
+            mods[i] = magnitude + nextRandom( state ) % ( 9 * magnitude );
+            values[i] = nextRandom( state ) % mods[i];
+        }
+        // ModularExp squares its operands in T, so keep them below 2^32
+        if ( selected( "ModularExp" ) && magnitude <= 100000000ULL ) {
+            double ns = bestNs( [&]() {
+                uLongInt sum = 0;
+                for ( int i = 0; i < count; i++ ) {
+                    sum += ModularExp<uLongInt>( values[i], mods[i] - 1, mods[i] );
+                }
+                sink = sum;
+            } );
+            row( "ModularExp", magnitude, count, ns, 0 );
+        }
+        if ( selected( "ModularInv" ) ) {
+            double ns = bestNs( [&]() {
+                long long sum = 0;
+                for ( int i = 0; i < count; i++ ) sum += ModularInv( values[i], mods[i] );
+                sink = sum;
+            } );
+            row( "ModularInv", magnitude, count, ns, 0 );
+        }
+        if ( selected( "multiModularInverse" ) ) {
+            std::vector<long long> out( count );
+            double ns = bestNs( [&]() { multiModularInverse( values.data(), mods.data(), count, out.data() ); sink = out[0]; } );
+            row( "multiModularInverse", magnitude, count, ns, 0 );
+        }
+    }
+}
+
+void divisors() {
+    if ( !selected( "calculateAllDivisors" ) ) return;
+    const int count = 1000;
+    for ( uLongInt n : magnitudes( 3, 15 ) ) {
+        std::vector<std::vector<uLongInt>> factors( count );
+        for ( int i = 0; i < count; i++ ) {
+            for ( const auto& f : factorize( n + i ) ) {
+                for ( int e = 0; e < f.second; e++ ) factors[i].push_back( f.first );
+            }
+        }
+        std::size_t bytes = 0;
+        double ns = bestNs( [&]() {
+            bytes = 0;
+            for ( int i = 0; i < count; i++ ) bytes += calculateAllDivisors( factors[i] ).capacity() * sizeof( uLongInt );
+            sink = bytes;
+        } );
+        row( "calculateAllDivisors", n, count, ns, (double) bytes );
+    }
+}
+
+void permutations() {
+    if ( selected( "nextLexicalPermutation" ) ) {
+        // length 4 to 11: 24 to ~40 million permutations
+        uLongInt count = 24;
+        for ( int length = 4; length <= 11 && count <= 10 * std::pow( 10.0, maxExponent ); length++ ) {
+            std::vector<int> permutation( length );
+            double ns = bestNs( [&]() {
+                for ( int i = 0; i < length; i++ ) permutation[i] = i;
+                while ( nextLexicalPermutation( permutation.data(), length ) );
+                sink = permutation[0];
+            } );
+            row( "nextLexicalPermutation", length, count, ns, 0 );
+            count *= length + 1;
+        }
+    }
+    if ( selected( "nextSeqNumericCombination" ) ) {
+        // 6 from max: 10 choose 6 = 210 up to 60 choose 6 = ~50 million
+        const int index = 6;
+        for ( int max = 10; max <= 60; max += 10 ) {
+            uLongInt count = 1;
+            for ( int i = 0; i < index; i++ ) count = count * ( max - i ) / ( i + 1 );
+            if ( count > 10 * std::pow( 10.0, maxExponent ) ) break;
+            int combination[index];
+            double ns = bestNs( [&]() {
+                for ( int i = 0; i < index; i++ ) combination[i] = i + 1;
+                uLongInt seen = 1;
+                while ( nextSeqNumericCombination( combination, index, max ) ) seen++;
+                sink = seen;
+            } );
+            row( "nextSeqNumericCombination", max, count, ns, 0 );
+        }
+    }
+}
+
+int main( int argc, char** argv ) {
+    for ( int i = 1; i < argc; i++ ) {
+        std::string arg = argv[i];
+        if ( arg == "--max-exponent" && i + 1 < argc ) {
+            maxExponent = std::atoi( argv[++i] );
+        } else {
+            filter = arg;
+        }
+    }
+
+    std::cout << "primitive,size,elements,ns_per_element,bytes_per_element" << std::endl;
+    sieves();
+    factorTables();
+    primality();
+    modular();
+    divisors();
+    permutations();
+    return 0;
+}
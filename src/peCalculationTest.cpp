@@ -1,5 +1,13 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <vector>
+#include <stdexcept>
 #include "peCalculation.h"
+#include "peCombinations.h"
+#include "peParallel.h"
+#include "peWideInt.h"
 
 typedef unsigned long long int uLongInt;
 
@@ -24,7 +32,350 @@ void ModularExpTest() {
 
 }
 
+void ModIntTest() {
+    std::cout << "ModInt test:" << std::endl;
+    bool pass = true;
+    const std::uint32_t bigPrime = 4294967291U;
+    DynModInt<>::setModulus( bigPrime );
+    uLongInt x = 123456789, y = 987654321;
+    for ( int i = 0; i < 100000; i++ ) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        y = y * 2862933555777941757ULL + 3037000493ULL;
+        uLongInt a = x >> 20, b = y >> 30;
+
+        ModInt<500500507> ma( a ), mb( b );
+        pass &= ( ma * mb ).value() == ( a % 500500507 ) * ( b % 500500507 ) % 500500507;
+        pass &= ( ma + mb ).value() == ( a + b ) % 500500507;
+        pass &= ( ma - mb + mb ) == ma;
+
+        ModInt<bigPrime> ba( a ), bb( b );
+        pass &= ( ba + bb ).value() == ( a % bigPrime + b % bigPrime ) % bigPrime;
+        pass &= ( ba * bb ).value() == (uLongInt)( (unsigned __int128) a * b % bigPrime );
+
+        DynModInt<> da( a ), db( b );
+        pass &= da.value() == a % bigPrime;
+        pass &= ( da * db ).value() == (uLongInt)( (unsigned __int128) a * b % bigPrime );
+        pass &= ( da - db + db ) == da;
+        if ( db.value() != 0 ) pass &= ( da / db * db ) == da;
+    }
+    pass &= ModInt<7>( -1 ).value() == 6 && ModInt<7>( -14 ).value() == 0;
+    pass &= ModInt<983827445>( 384721332245ULL ).pow( 3423433464232ULL ).value() == 953686460;
+    DynModInt<>::setModulus( 983827445 );
+    pass &= DynModInt<>( 384721332245ULL ).pow( 3423433464232ULL ).value() == 953686460;
+    try {
+        ModInt<10>( 4 ).inv();
+        pass = false;
+    } catch ( const std::domain_error& ) {}
+
+    if ( pass ) {
+        std::cout << "Passed" << std::endl;
+    } else {
+        std::cout << "Failed" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Unsigned integer that counts its multiplications
+ */
+struct CountingInt {
+    static long long multiplications;
+    uLongInt v;
+    CountingInt( uLongInt v = 0 ) : v( v ) {}
+    CountingInt operator*( const CountingInt& o ) const { multiplications++; return v * o.v; }
+    CountingInt operator%( const CountingInt& o ) const { return v % o.v; }
+    CountingInt& operator%=( const CountingInt& o ) { v %= o.v; return *this; }
+    CountingInt& operator>>=( const CountingInt& o ) { v >>= o.v; return *this; }
+    bool operator>( const CountingInt& o ) const { return v > o.v; }
+    bool operator==( const CountingInt& o ) const { return v == o.v; }
+};
+long long CountingInt::multiplications = 0;
+
+void ModularExpVariantsTest() {
+    std::cout << "Sliding window / fixed base exponentiation test:" << std::endl;
+    bool pass = true;
+    const uLongInt mod = 4294967291ULL;
+    const int calls = 200000;
+    std::vector<uLongInt> exps( calls );
+    uLongInt x = 42;
+    for ( auto& e : exps ) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        e = x;
+    }
+    exps[0] = 0;
+    exps[1] = 1;
+
+    FixedBaseExp<uLongInt> fixed( 3, mod );
+    for ( int i = 0; i < calls; i++ ) {
+        uLongInt base = exps[( i + 1 ) % calls] % mod;
+        uLongInt expected = ModularExp<uLongInt>( base, exps[i], mod );
+        pass &= ModularExpWindow<uLongInt>( base, exps[i], mod ) == expected;
+        // shorter exponents reach every window size, chosen and given
+        const uLongInt shorter = exps[i] >> ( i % 64 );
+        const uLongInt shorterExpected = ModularExp<uLongInt>( base, shorter, mod );
+        pass &= ModularExpWindow<uLongInt>( base, shorter, mod ) == shorterExpected;
+        pass &= ModularExpWindow<uLongInt>( base, shorter, mod, 1 + i % 6 ) == shorterExpected;
+        pass &= fixed( exps[i] ) == ModularExp<uLongInt>( 3, exps[i], mod );
+    }
+    FixedBaseExp<uLongInt> wide( 384721332245ULL, 983827445ULL, 42, 7 );
+    pass &= wide( 3423433464232ULL ) == 953686460;
+    // bad table shapes are rejected before anything is shifted or allocated
+    for ( int windowBits : { 0, -1, 17, 64 } ) {
+        try {
+            FixedBaseExp<uLongInt>( 3, 1000003, 64, windowBits );
+            pass = false;
+        } catch ( const std::domain_error& ) {}
+    }
+    for ( int maxExpBits : { 0, -5, 65 } ) {
+        try {
+            FixedBaseExp<uLongInt>( 3, 1000003, maxExpBits, 4 );
+            pass = false;
+        } catch ( const std::domain_error& ) {}
+    }
+
+    // multiplications per 64-bit exponent
+    const int counted = 1000;
+    CountingInt::multiplications = 0;
+    for ( int i = 0; i < counted; i++ ) ModularExp<CountingInt>( 3, exps[i], mod );
+    double binaryMuls = CountingInt::multiplications / (double) counted;
+    CountingInt::multiplications = 0;
+    for ( int i = 0; i < counted; i++ ) ModularExpWindow<CountingInt>( 3, exps[i], mod );
+    double windowMuls = CountingInt::multiplications / (double) counted;
+    FixedBaseExp<CountingInt> countingFixed( 3, mod );
+    CountingInt::multiplications = 0;
+    for ( int i = 0; i < counted; i++ ) countingFixed( exps[i] );
+    double fixedMuls = CountingInt::multiplications / (double) counted;
+
+    // wall time for the same calls
+    uLongInt sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for ( int i = 0; i < calls; i++ ) sink += ModularExp<uLongInt>( 3, exps[i], mod );
+    auto t1 = std::chrono::steady_clock::now();
+    for ( int i = 0; i < calls; i++ ) sink += ModularExpWindow<uLongInt>( 3, exps[i], mod );
+    auto t2 = std::chrono::steady_clock::now();
+    for ( int i = 0; i < calls; i++ ) sink += fixed( exps[i] );
+    auto t3 = std::chrono::steady_clock::now();
+    auto perCall = []( std::chrono::steady_clock::duration d ) {
+        return std::chrono::duration<double, std::nano>( d ).count() / calls;
+    };
+
+    std::cout << "ModularExp:\t\t " << binaryMuls << " multiplies, " << perCall( t1 - t0 ) << " ns/call" << std::endl;
+    std::cout << "ModularExpWindow:\t " << windowMuls << " multiplies, " << perCall( t2 - t1 ) << " ns/call" << std::endl;
+    std::cout << "FixedBaseExp:\t\t " << fixedMuls << " multiplies, " << perCall( t3 - t2 ) << " ns/call" << std::endl;
+    if ( sink == 1 ) std::cout << std::endl; // keep the timed loops alive
+
+    if ( pass ) {
+        std::cout << "Passed" << std::endl;
+    } else {
+        std::cout << "Failed" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void WideIntTest() {
+    std::cout << "WideInt test:" << std::endl;
+    typedef unsigned __int128 u128;
+    bool pass = true;
+    uLongInt x = 88172645463325252ULL, y = 1442695040888963407ULL;
+    for ( int i = 0; i < 100000; i++ ) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        y ^= y << 13; y ^= y >> 7; y ^= y << 17;
+        u128 a = ( (u128) x << 64 ) | y, b = ( (u128) y << ( x % 64 ) ) | ( x >> 3 );
+        UInt128 wa( a ), wb( b );
+        pass &= ( wa + wb ) == UInt128( a + b );
+        pass &= ( wa - wb ) == UInt128( a - b );
+        pass &= ( wa * wb ) == UInt128( a * b );
+        pass &= ( wa < wb ) == ( a < b );
+        pass &= ( wa >> (int)( y % 128 ) ) == UInt128( a >> ( y % 128 ) );
+        pass &= ( wa << (int)( x % 128 ) ) == UInt128( a << ( x % 128 ) );
+        if ( b != 0 ) {
+            pass &= ( wa / wb ) == UInt128( a / b ) && ( wa % wb ) == UInt128( a % b );
+        }
+        std::uint64_t r;
+        pass &= wa.divide64( x | 1, &r ) == UInt128( a / ( x | 1 ) ) && r == (uLongInt)( a % ( x | 1 ) );
+
+        // the full product checked through its 64-bit halves
+        UInt256 full = multiplyFull( UInt128( x ), UInt128( y ) );
+        pass &= UInt128( full ) == UInt128( (u128) x * y ) && full.w[2] == 0;
+        UInt256 square = multiplyFull( wa, wa );
+        pass &= UInt128( square % UInt256( wa ) ) == 0 && UInt128( square / UInt256( wa ) ) == wa;
+
+        UInt128 product;
+        pass &= !mulOverflow( UInt128( x ), UInt128( y ), &product ) && product == UInt128( (u128) x * y );
+        pass &= mulOverflow( wa, wa, &product ) == ( a >> 64 != 0 );
+    }
+
+    // generic templates over the wide types
+    uLongInt mod = 18446744073709551557ULL; // largest 64-bit prime
+    pass &= ModularExp<UInt128, UInt128>( 384721332245ULL, 3423433464232ULL, 983827445ULL ) == 953686460;
+    pass &= ModularExp<UInt128, UInt128>( 3, mod - 1, mod ) == 1;
+    UInt128 bigMod = ( UInt128( 1 ) << 127 ) - 1; // Mersenne prime
+    pass &= ModularExp<UInt256, UInt256>( 5, UInt256( bigMod - 1 ), UInt256( bigMod ) ) == 1;
+    pass &= mulMod( bigMod - 1, bigMod - 1, bigMod ) == 1;
+    UInt128 q, rem;
+    integerDivision( bigMod, UInt128( 1000000007 ), &q, &rem );
+    pass &= q * 1000000007 + rem == bigMod && rem < 1000000007;
+    pass &= bigMod.toString() == "170141183460469231731687303715884105727";
+    pass &= UInt256( 0 ).toString() == "0" && ( UInt256( 0 ) - 1 ) == UInt256::max();
+
+    if ( pass ) {
+        std::cout << "Passed" << std::endl;
+    } else {
+        std::cout << "Failed" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Checks both batched inverses against ModularInv and compares their
+ * throughput with one ModularInv per value
+ */
+void BatchInverseTest() {
+    std::cout << "Batch modular inverse test:" << std::endl;
+    typedef long long int int64;
+    const int count = 100000;
+    const int64 prime = 1000000007, composite = 1000000008;
+    std::vector<int64> values( count ), mods( count ), expected( count ), result( count );
+    uLongInt x = 88172645463325252ULL;
+    for ( int i = 0; i < count; i++ ) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        values[i] = x % prime;
+        mods[i] = 3 + ( x >> 33 ) % 1000000000;
+    }
+    values[7] = 0;
+    bool pass = true;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for ( int i = 0; i < count; i++ ) expected[i] = ModularInv( values[i], prime );
+    auto t1 = std::chrono::steady_clock::now();
+    batchModularInverse( values.data(), count, prime, result.data() );
+    auto t2 = std::chrono::steady_clock::now();
+    pass &= result == expected;
+
+    auto t3 = std::chrono::steady_clock::now();
+    for ( int i = 0; i < count; i++ ) expected[i] = ModularInv( values[i], mods[i] );
+    auto t4 = std::chrono::steady_clock::now();
+    multiModularInverse( values.data(), mods.data(), count, result.data() );
+    auto t5 = std::chrono::steady_clock::now();
+    pass &= result == expected;
+
+    // a value sharing a factor with the modulus must not spoil the others
+    for ( int i = 0; i < 1000; i++ ) expected[i] = ModularInv( values[i] % composite, composite );
+    batchModularInverse( values.data(), 1000, composite, result.data() );
+    pass &= std::equal( expected.begin(), expected.begin() + 1000, result.begin() );
+
+    auto perValue = [count]( std::chrono::steady_clock::duration d ) {
+        return std::chrono::duration<double, std::nano>( d ).count() / count;
+    };
+    std::cout << "ModularInv, one modulus:\t " << perValue( t1 - t0 ) << " ns/value" << std::endl;
+    std::cout << "batchModularInverse:\t\t " << perValue( t2 - t1 ) << " ns/value" << std::endl;
+    std::cout << "ModularInv, many moduli:\t " << perValue( t4 - t3 ) << " ns/value" << std::endl;
+    std::cout << "multiModularInverse:\t\t " << perValue( t5 - t4 ) << " ns/value" << std::endl;
+
+    if ( pass ) {
+        std::cout << "Passed" << std::endl;
+    } else {
+        std::cout << "Failed" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * parallelFor must visit every index exactly once and parallelReduce must
+ * give identical results, bit for bit, whatever the thread count
+ */
+void ParallelTest() {
+    std::cout << "Parallel loop test:" << std::endl;
+    bool pass = true;
+    const std::int64_t n = 1000003;
+    auto term = []( std::int64_t i ) { return 1.0 / ( (double) i * i + 1 ); };
+    ThreadPool serial( 1 );
+    const double reference = parallelReduce( 0, n, 0.0, term, std::plus<double>(), 0, serial );
+    for ( unsigned int threads : { 1u, 2u, 3u, 8u } ) {
+        ThreadPool pool( threads );
+        std::vector<std::atomic<int>> visits( n );
+        parallelFor( 0, n, [&visits]( std::int64_t i ) { visits[i]++; }, 0, pool );
+        pass &= std::all_of( visits.begin(), visits.end(), []( const std::atomic<int>& v ) { return v == 1; } );
+
+        pass &= parallelReduce( 0, n, 0.0, term, std::plus<double>(), 0, pool ) == reference;
+        pass &= parallelReduce( 0, n, 0LL, []( std::int64_t i ) { return ( i * 7919 ) % 1000003; },
+                                []( long long a, long long b ) { return std::max( a, b ); }, 0, pool ) == 1000002;
+        // nested loops run serially on the worker that meets them
+        long long nested = parallelReduce( 0, 100, 0LL, [&pool]( std::int64_t i ) {
+            return parallelReduce( 0, i, 0LL, []( std::int64_t j ) { return j; }, std::plus<long long>(), 0, pool );
+        }, std::plus<long long>(), 1, pool );
+        pass &= nested == 161700;
+
+        bool thrown = false;
+        try {
+            parallelFor( 0, n, []( std::int64_t i ) { if ( i == 12345 ) throw std::runtime_error( "body" ); }, 0, pool );
+        } catch ( const std::runtime_error& ) {
+            thrown = true;
+        }
+        pass &= thrown;
+        if ( !pass ) std::cout << "Failed with " << threads << " threads" << std::endl;
+    }
+
+    if ( pass ) {
+        std::cout << "Passed" << std::endl;
+    } else {
+        std::cout << "Failed" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/*
+ * Closed form count of Pascal entries not divisible by p against Lucas'
+ * theorem row by row, plus exact values beyond 64 bits
+ */
+void PascalNonMultiplesTest() {
+    std::cout << "Pascal non-multiples test:" << std::endl;
+    bool pass = true;
+    for ( std::uint64_t p : { 2, 3, 5, 7, 11, 13, 97, 1000003 } ) {
+        for ( std::uint64_t rows = 0; rows <= 3000; rows++ ) {
+            pass &= pascalNonMultiples( rows, p ) == pascalNonMultiplesByRow( rows, p );
+        }
+        for ( std::uint64_t rows : { 100000, 823543, 1000000, 1234567 } ) {
+            pass &= pascalNonMultiples( rows, p ) == pascalNonMultiplesByRow( rows, p );
+        }
+    }
+    pass &= pascalNonMultiples( 100, 7 ) == 2361;
+    pass &= pascalNonMultiples( 1000000000, 7 ) == 2129970655314432ULL;
+
+    typedef unsigned __int128 uint128;
+    uint128 powerOf3 = 1;
+    for ( int i = 0; i < 60; i++ ) powerOf3 *= 3;
+    pass &= pascalNonMultiples<uint128>( 1ULL << 60, 2 ) == powerOf3;
+    // p above the row count divides nothing
+    const std::uint64_t rows = 1000000000000000000ULL, p = ( 1ULL << 61 ) - 1;
+    pass &= pascalNonMultiples<uint128>( rows, p ) == (uint128) rows * ( rows + 1 ) / 2;
+    pass &= pascalNonMultiples<UInt128>( rows, p ) == UInt128( rows ) * UInt128( rows + 1 ) / 2;
+    for ( std::uint64_t composite : { 0, 1, 4, 6, 1000001 } ) {
+        try {
+            pascalNonMultiples( 100, composite );
+            pass = false;
+        } catch ( const std::invalid_argument& ) {}
+        try {
+            pascalNonMultiplesByRow( 100, composite );
+            pass = false;
+        } catch ( const std::invalid_argument& ) {}
+    }
+
+    if ( pass ) {
+        std::cout << "Passed" << std::endl;
+    } else {
+        std::cout << "Failed" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
 int main() {
     ModularExpTest();
+    ModIntTest();
+    ModularExpVariantsTest();
+    WideIntTest();
+    BatchInverseTest();
+    ParallelTest();
+    PascalNonMultiplesTest();
     return 0;
 }
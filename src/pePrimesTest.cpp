@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "pePrimes.h"
+#include "peWideInt.h"
+
+/*
+ * Reference sieve; the unsegmented version
+ */
+std::vector<bool> simplePrimalityTable( long long upper ) {
+    std::vector<bool> primes( upper, true );
+    primes[0] = false;
+    primes[1] = false;
+    for ( long long i = 2; i * i < upper; i++ ) {
+        if ( primes[i] ) {
+            for ( long long j = i*i; j < upper; j += i ) {
+                primes[j] = false;
+            }
+        }
+    }
+    return primes;
+}
+
+void report( bool pass ) {
+    std::cout << ( pass ? "Passed" : "Failed" ) << std::endl;
+    std::cout << std::endl;
+}
+
+void SegmentedSieveTest() {
+    std::cout << "Segmented sieve test:" << std::endl;
+    bool pass = true;
+    for ( long long upper : { 2, 3, 4, 11, 12, 1000, 65536, 65537, 1000003 } ) {
+        if ( generatePrimalityTable<long long>( upper ) != simplePrimalityTable( upper ) ) {
+            std::cout << "Table mismatch for upper = " << upper << std::endl;
+            pass = false;
+        }
+    }
+
+    // independent segments with small blocks
+    const long long width = 100000;
+    for ( long long low : { 0LL, 1LL, 2LL, 3LL, 97LL, 1000000LL, 999999937LL } ) {
+        std::vector<bool> table = simplePrimalityTable( low + width );
+        std::vector<long long> expected, calculated;
+        for ( long long i = low; i < low + width; i++ ) {
+            if ( table[i] ) expected.push_back( i );
+        }
+        SegmentedSieve sieve( low, low + width, 1000 );
+        while ( sieve.nextBlock() ) {
+            sieve.forEachPrime( [&calculated]( std::uint64_t p ) { calculated.push_back( p ); } );
+        }
+        if ( expected != calculated ) {
+            std::cout << "Segment mismatch for low = " << low << std::endl;
+            pass = false;
+        }
+    }
+
+    std::vector<int> primes = generatePrimeList<int>( 10000000 );
+    if ( primes.size() != 664579 || primes.back() != 9999991 ) {
+        std::cout << "Expected 664579 primes below 10^7, ending 9999991" << std::endl;
+        std::cout << "Calculated:\t " << primes.size() << ", " << primes.back() << std::endl;
+        pass = false;
+    }
+    report( pass );
+}
+
+void PrimalityBitsetTest() {
+    std::cout << "Primality bitset test:" << std::endl;
+    bool pass = true;
+    for ( long long upper : { 0, 1, 2, 3, 5, 6, 7, 8, 30, 31, 1000, 1000003 } ) {
+        PrimalityBitset bitset( upper );
+        std::vector<bool> table = simplePrimalityTable( std::max( upper, 2LL ) );
+        std::vector<long long> expected, calculated;
+        for ( long long i = 0; i < upper; i++ ) {
+            if ( bitset.test( i ) != table[i] ) pass = false;
+            if ( table[i] ) expected.push_back( i );
+        }
+        for ( std::uint64_t p : bitset ) calculated.push_back( p );
+        if ( expected != calculated ) {
+            std::cout << "Iteration mismatch for upper = " << upper << std::endl;
+            pass = false;
+        }
+    }
+
+    for ( long long upper : { 0, 2, 3, 100, 101 } ) {
+        PrimalityBitset small( upper );
+        for ( long long n : { 1LL, 2LL, 97LL, 10007LL, 10201LL, 10403LL, 100140049LL, 999999937LL,
+                              1000000007LL * 3, 1000003LL * 1000033LL } ) {
+            if ( isPrime( n, small ) != isPrime( n ) ) {
+                std::cout << "isPrime mismatch for " << n << " with a table below " << upper << std::endl;
+                pass = false;
+            }
+        }
+    }
+    report( pass );
+}
+
+void ParallelPrimeListTest() {
+    std::cout << "Parallel prime list test:" << std::endl;
+    bool pass = true;
+    for ( int upper : { 10, 100000, 1000003, 20000000 } ) {
+        std::vector<int> serial = generatePrimeList<int>( upper );
+        for ( unsigned int threads : { 1u, 2u, 3u, 16u } ) {
+            if ( generatePrimeListParallel<int>( upper, threads ) != serial ) {
+                std::cout << "Mismatch for upper = " << upper << ", threads = " << threads << std::endl;
+                pass = false;
+            }
+        }
+    }
+    report( pass );
+}
+
+void PrimeStreamTest() {
+    std::cout << "Prime stream test:" << std::endl;
+    bool pass = true;
+    std::vector<long long> primes = generatePrimeList<long long>( 2000000 );
+
+    std::vector<long long> streamed;
+    for ( std::uint64_t p : PrimeStream() ) {
+        if ( p >= 2000000 ) break;
+        streamed.push_back( p );
+    }
+    if ( streamed != primes ) {
+        std::cout << "Unbounded stream mismatch" << std::endl;
+        pass = false;
+    }
+
+    PrimeStream bounded( 1000, 1100 );
+    std::vector<long long> expected, calculated;
+    for ( long long p : primes ) if ( p >= 1000 && p < 1100 ) expected.push_back( p );
+    while ( std::uint64_t p = bounded.next() ) calculated.push_back( p );
+    if ( expected != calculated || bounded.next() != 0 ) {
+        std::cout << "Bounded stream mismatch" << std::endl;
+        pass = false;
+    }
+
+    for ( std::size_t n = 1; n <= primes.size(); n++ ) {
+        if ( nthPrimeUpperBound( n ) < (std::uint64_t) primes[n - 1] ) {
+            std::cout << "Bound too small for n = " << n << std::endl;
+            pass = false;
+            break;
+        }
+    }
+    for ( std::size_t n : { 0, 1, 5, 6, 39016, 39017, 148933 } ) {
+        std::vector<long long> first = firstNPrimes<long long>( n );
+        if ( first != std::vector<long long>( primes.begin(), primes.begin() + n ) ) {
+            std::cout << "firstNPrimes mismatch for n = " << n << std::endl;
+            pass = false;
+        }
+    }
+    report( pass );
+}
+
+void PrimeCountingTest() {
+    std::cout << "Prime counting test:" << std::endl;
+    bool pass = true;
+    for ( std::uint64_t n : { 0, 1, 2, 3, 4, 10, 11, 1000, 12345, 999983, 2000000 } ) {
+        std::vector<std::uint64_t> primes = generatePrimeList<std::uint64_t>( n + 1 );
+        std::uint64_t sum = 0;
+        std::vector<std::uint64_t> mod3( 3, 0 ), mod7( 7, 0 );
+        for ( std::uint64_t p : primes ) {
+            sum += p;
+            mod3[p % 3]++;
+            mod7[p % 7]++;
+        }
+        if ( primePi( n ) != primes.size() || primeSum<std::uint64_t>( n ) != sum ||
+             primePiByResidue( n, 3 ) != mod3 || primePiByResidue( n, 7 ) != mod7 ) {
+            std::cout << "Mismatch against sieve for n = " << n << std::endl;
+            pass = false;
+        }
+    }
+
+    std::uint64_t n = 10000000000ULL;
+    unsigned __int128 sum = primeSum( n );
+    if ( primePi( n ) != 455052511 || (std::uint64_t) sum != 2220822432581729238ULL || ( sum >> 64 ) != 0 ||
+         primePi( n, 3, 1 ) != 227523123 || primePi( n, 3, 2 ) != 227529387 ) {
+        std::cout << "Mismatch against known values for n = 10^10" << std::endl;
+        pass = false;
+    }
+    report( pass );
+}
+
+void PrimeFactorsListTest() {
+    std::cout << "Prime factors list test:" << std::endl;
+    bool pass = true;
+    PrimeFactorsList<long long> factorList( 100000 );
+    std::vector<long long> buffer;
+    for ( std::size_t n = 2; n < 100000; n++ ) {
+        std::vector<long long> expected = factorList[n];
+        factorList.getFactors( n, &buffer );
+        if ( buffer != expected ) pass = false;
+
+        PrimeFactorization<long long> grouped = factorList.factorize( n );
+        long long product = 1;
+        for ( int i = 0; i < grouped.size(); i++ ) {
+            if ( i > 0 && grouped[i - 1].first >= grouped[i].first ) pass = false;
+            for ( int e = 0; e < grouped[i].second; e++ ) product *= grouped[i].first;
+        }
+        if ( product != (long long) n ) pass = false;
+        if ( EulerTotient( grouped ) != EulerTotient( std::vector<int>( expected.begin(), expected.end() ) ) ) pass = false;
+        if ( !pass ) {
+            std::cout << "Mismatch for n = " << n << std::endl;
+            break;
+        }
+    }
+    report( pass );
+}
+
+template<typename Storage>
+bool compareStorage( const PrimeFactorsList<long long>& reference, std::size_t length ) {
+    PrimeFactorsList<long long, Storage> compact( length );
+    if ( compact.getLowestFactor( 0 ) != 0 || compact.getLowestFactor( 1 ) != 1 ) {
+        std::cout << "getLowestFactor mismatch for 0 or 1" << std::endl;
+        return false;
+    }
+    for ( std::size_t n = 2; n < length; n++ ) {
+        std::vector<long long> expected = reference[n];
+        std::vector<long long> calculated = compact[n];
+        std::sort( expected.begin(), expected.end() );
+        std::sort( calculated.begin(), calculated.end() );
+        if ( expected != calculated || reference.isPrime( n ) != compact.isPrime( n )
+             || reference.getLowestFactor( n ) != compact.getLowestFactor( n ) ) {
+            std::cout << "Storage mismatch for n = " << n << std::endl;
+            return false;
+        }
+        PrimeFactorization<long long> a = reference.factorize( n ), b = compact.factorize( n );
+        if ( !std::equal( a.begin(), a.end(), b.begin(), b.end() ) ) {
+            std::cout << "Grouped mismatch for n = " << n << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void FactorStorageTest() {
+    std::cout << "Factor storage policy test:" << std::endl;
+    const std::size_t length = 200000;
+    PrimeFactorsList<long long> reference( length );
+    bool pass = compareStorage< CofactorStorage<std::uint32_t> >( reference, length )
+             && compareStorage< SmallestFactorStorage<std::uint32_t> >( reference, length )
+             && compareStorage< SmallestFactorStorage<std::uint16_t> >( reference, length )
+             && compareStorage< PrimeIndexStorage<std::uint16_t> >( reference, length )
+             && compareStorage< PrimeIndexStorage<std::uint8_t> >( reference, 2000 );
+
+    try {
+        PrimeFactorsList<int, SmallestFactorStorage<std::uint8_t> > tooLong( 70000 );
+        std::cout << "Expected length_error for 8-bit storage" << std::endl;
+        pass = false;
+    } catch ( const std::length_error& ) {}
+    report( pass );
+}
+
+void MillerRabinTest() {
+    std::cout << "64-bit Miller-Rabin test:" << std::endl;
+    bool pass = true;
+    std::vector<bool> table = generatePrimalityTable<long long>( 1000000 );
+    for ( std::uint64_t n = 0; n < table.size(); n++ ) {
+        if ( isMrPrime64( n ) != table[n] ) {
+            std::cout << "Mismatch against sieve for n = " << n << std::endl;
+            pass = false;
+            break;
+        }
+    }
+
+    // largest 64-bit prime; square of the largest 32-bit prime;
+    // strong pseudoprimes to small bases; 2^64 - 1
+    const std::uint64_t primes[] = { 18446744073709551557ULL, 4294967291ULL, 1000000000000000003ULL };
+    const std::uint64_t composites[] = { 18446744030759878681ULL, 3215031751ULL, 3825123056546413051ULL,
+                                         2152302898747ULL, 18446744073709551615ULL };
+    for ( std::uint64_t p : primes ) if ( !isMrPrime64( p ) ) pass = false;
+    for ( std::uint64_t c : composites ) if ( isMrPrime64( c ) ) pass = false;
+    if ( !isMrPrime( 97 ) || isMrPrime( -97 ) || !isMrPrime<std::uint64_t>( 4294967291ULL ) ) pass = false;
+    // generic path over a wide type: squares of 64-bit values must not overflow
+    if ( !isMrPrime<UInt128, UInt128>( 18446744073709551557ULL ) || isMrPrime<UInt128, UInt128>( 3215031751ULL ) ) pass = false;
+    report( pass );
+}
+
+/*
+ * Checks isMrPrimeBatch against isMrPrime64 and compares their throughput
+ * on candidates shaped like those in 146 (n^2 + d)
+ */
+void MillerRabinBatchTest() {
+    std::cout << "Batched Miller-Rabin test:" << std::endl;
+    const int offsets[] = { 1, 3, 7, 9, 13, 27, 19, 21 };
+    std::vector<std::uint64_t> candidates;
+    for ( std::uint64_t n = 10; candidates.size() < 400000; n += 10 ) {
+        for ( int d : offsets ) candidates.push_back( ( n * 7919 ) * ( n * 7919 ) + d );
+    }
+    candidates.push_back( 0 );
+    candidates.push_back( 2 );
+    candidates.push_back( 18446744073709551557ULL );
+
+    auto scalarStart = std::chrono::steady_clock::now();
+    std::vector<bool> expected( candidates.size() );
+    for ( std::size_t i = 0; i < candidates.size(); i++ ) expected[i] = isMrPrime64( candidates[i] );
+    auto batchStart = std::chrono::steady_clock::now();
+    std::vector<std::uint64_t> mask( ( candidates.size() + 63 ) / 64 );
+    isMrPrimeBatch( candidates.data(), candidates.size(), mask.data() );
+    auto batchEnd = std::chrono::steady_clock::now();
+
+    bool pass = true;
+    for ( std::size_t i = 0; i < candidates.size(); i++ ) {
+        if ( ( ( mask[i / 64] >> ( i % 64 ) ) & 1 ) != expected[i] ) {
+            std::cout << "Mismatch for " << candidates[i] << std::endl;
+            pass = false;
+            break;
+        }
+    }
+    double scalarNs = std::chrono::duration<double, std::nano>( batchStart - scalarStart ).count() / candidates.size();
+    double batchNs = std::chrono::duration<double, std::nano>( batchEnd - batchStart ).count() / candidates.size();
+    std::cout << "Scalar:\t " << scalarNs << " ns/candidate" << std::endl;
+    std::cout << "Batch:\t " << batchNs << " ns/candidate" << std::endl;
+    report( pass );
+}
+
+bool checkFactorization( std::uint64_t n, const PrimeFactorization<std::uint64_t>& factors ) {
+    unsigned __int128 product = 1;
+    std::uint64_t previous = 0;
+    for ( const auto& factor : factors ) {
+        if ( factor.first <= previous || !isMrPrime64( factor.first ) ) return false;
+        previous = factor.first;
+        for ( int e = 0; e < factor.second; e++ ) product *= factor.first;
+    }
+    return product == n;
+}
+
+void FactorizeTest() {
+    std::cout << "Pollard-Rho factorize test:" << std::endl;
+    bool pass = true;
+    PrimeFactorsList<std::uint64_t, SmallestFactorStorage<std::uint32_t> > factorList( 100000 );
+    for ( std::uint64_t n = 1; n < 100000; n++ ) {
+        PrimeFactorization<std::uint64_t> a = factorize( n ), b = factorList.factorize( n );
+        if ( !std::equal( a.begin(), a.end(), b.begin(), b.end() ) ) {
+            std::cout << "Mismatch against table for n = " << n << std::endl;
+            pass = false;
+            break;
+        }
+    }
+
+    const std::uint64_t hard[] = { 4294967291ULL * 4294967279ULL, 4294967291ULL * 4294967291ULL,
+                                   18446744073709551615ULL, 18446744073709551557ULL, 1ULL << 63,
+                                   27ULL * 1000003ULL * 1000003ULL, 3ULL * 65537ULL * 65537ULL * 65537ULL };
+    for ( std::uint64_t n : hard ) {
+        if ( !checkFactorization( n, factorize( n ) ) ) {
+            std::cout << "Incorrect factorisation of " << n << std::endl;
+            pass = false;
+        }
+    }
+
+    std::uint64_t n = 0x9E3779B97F4A7C15ULL;
+    auto start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < 2000; i++ ) {
+        n = n * 6364136223846793005ULL + 1442695040888963407ULL;
+        if ( !checkFactorization( n, factorize( n ) ) ) {
+            std::cout << "Incorrect factorisation of " << n << std::endl;
+            pass = false;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "Random 64-bit:\t " << std::chrono::duration<double, std::micro>( end - start ).count() / 2000
+              << " us/factorisation" << std::endl;
+    report( pass );
+}
+
+void DivisorTest() {
+    std::cout << "Divisor enumeration test:" << std::endl;
+    bool pass = true;
+    std::vector<std::uint64_t> divisors;
+    for ( std::uint64_t n = 1; n < 20000; n++ ) {
+        std::vector<std::uint64_t> expected;
+        for ( std::uint64_t d = 1; d <= n; d++ ) if ( n % d == 0 ) expected.push_back( d );
+        PrimeFactorization<std::uint64_t> factors = factorize( n );
+
+        generateDivisors( factors, &divisors, std::uint64_t( 1 ), std::numeric_limits<std::uint64_t>::max(), true );
+        bool ok = divisors == expected;
+
+        std::uint64_t low = n / 7, high = n / 2;
+        std::vector<std::uint64_t> window;
+        for ( std::uint64_t d : expected ) if ( d >= low && d <= high ) window.push_back( d );
+        generateDivisors( factors, &divisors, low, high );
+        std::sort( divisors.begin(), divisors.end() );
+        ok &= divisors == window;
+
+        std::uint64_t sum = 0;
+        for ( std::uint64_t d : expected ) sum += d;
+        ok &= divisorCount( factors ) == expected.size() && divisorSum( factors ) == sum;
+
+        if ( !ok ) {
+            std::cout << "Mismatch for n = " << n << std::endl;
+            pass = false;
+            break;
+        }
+    }
+
+    // m^2 - 1 from the factors of m - 1 and m + 1, as in 451
+    PrimeFactorsList<std::uint64_t> factorList( 10000 );
+    for ( std::uint64_t m = 2; m < 9999; m++ ) {
+        PrimeFactorization<std::uint64_t> product = multiplyFactorizations( factorList.factorize( m - 1 ), factorList.factorize( m + 1 ) );
+        PrimeFactorization<std::uint64_t> direct = factorize( m * m - 1 );
+        std::vector<std::uint64_t> merged = factorList[m - 1];
+        std::vector<std::uint64_t> high = factorList[m + 1];
+        merged.insert( merged.end(), high.begin(), high.end() );
+        std::vector<std::uint64_t> fromList = calculateAllDivisors( merged );
+        std::sort( fromList.begin(), fromList.end() );
+        generateDivisors( direct, &divisors, std::uint64_t( 1 ), std::numeric_limits<std::uint64_t>::max(), true );
+        if ( !std::equal( product.begin(), product.end(), direct.begin(), direct.end() ) || fromList != divisors ) {
+            std::cout << "Mismatch for m^2 - 1, m = " << m << std::endl;
+            pass = false;
+            break;
+        }
+    }
+    report( pass );
+}
+
+/*
+ * The constexpr helpers must agree with their runtime counterparts;
+ * the static_asserts fail the build rather than the run
+ */
+void ConstexprTest() {
+    std::cout << "Compile time tables test:" << std::endl;
+    static constexpr auto primes = smallPrimes<100>();
+    static_assert( primes[0] == 2 && primes[24] == 97 && primes[99] == 541, "smallPrimes" );
+    static_assert( isPrime( 541 ) && !isPrime( 0 ) && !isPrime( 1 ) && !isPrime( 561 ), "isPrime" );
+    static_assert( ModularExp<long long>( 384721332245LL, 3423433464232LL, 983827445LL ) == 953686460, "ModularExp" );
+    static_assert( ModularInv( 3, 7 ) == 5 && ModularInv( 2, 4 ) == 0, "ModularInv" );
+
+    bool pass = true;
+    std::vector<int> runtimePrimes = generatePrimeList<int>( 542 );
+    pass &= std::equal( primes.begin(), primes.end(), runtimePrimes.begin() ) && runtimePrimes.size() == primes.size();
+    report( pass );
+}
+
+int main() {
+    SegmentedSieveTest();
+    PrimalityBitsetTest();
+    ParallelPrimeListTest();
+    PrimeStreamTest();
+    PrimeCountingTest();
+    PrimeFactorsListTest();
+    FactorStorageTest();
+    MillerRabinTest();
+    MillerRabinBatchTest();
+    FactorizeTest();
+    DivisorTest();
+    ConstexprTest();
+    return 0;
+}